@@ -0,0 +1,97 @@
+/*
+    layout of the binary log written by the kLogToBinary destination.
+    Shared by the writer (logging.c) and the reader (fflogdump.c).
+
+    The file is a tBinLogHeader followed by a stream of records. Messages
+    refer to their format string (and source file) by address, the text
+    behind each address is written once per thread as a kBinLogString
+    record. Records may refer to a string defined later in the file, so
+    a reader has to collect the definitions before rendering anything.
+*/
+
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <stdint.h>
+
+#define kBinLogMagic        "FFTBLOG1"
+#define kBinLogVersion      1
+
+typedef struct {
+    char        magic[8];       /* kBinLogMagic, not terminated */
+    uint32_t    version;        /* kBinLogVersion */
+    uint32_t    scopeCount;     /* number of kBinLogScope records that follow */
+} tBinLogHeader;
+
+typedef enum {
+    kBinLogString  = 'S',       /* tBinLogString, then the text (not terminated) */
+    kBinLogScope   = 'N',       /* tBinLogScope, then the scope name (not terminated) */
+    kBinLogMessage = 'M'        /* tBinLogMessage, then the encoded arguments */
+} eBinLogRecord;
+
+typedef struct __attribute__((packed)) {
+    uint8_t     type;           /* kBinLogString */
+    uint64_t    address;        /* address of the string in the process that wrote the log */
+    uint16_t    length;
+} tBinLogString;
+
+typedef struct __attribute__((packed)) {
+    uint8_t     type;           /* kBinLogScope */
+    uint16_t    scope;
+    uint16_t    length;
+} tBinLogScope;
+
+typedef struct __attribute__((packed)) {
+    uint8_t     type;           /* kBinLogMessage */
+    uint8_t     priority;
+    uint16_t    scope;
+    uint32_t    line;           /* zero if the call site didn't record a location */
+    uint64_t    timestamp;      /* nanoseconds since the epoch */
+    uint64_t    format;         /* address of the format string */
+    uint64_t    file;           /* address of __FILE__, or zero */
+    uint16_t    argBytes;       /* length of the encoded arguments that follow */
+} tBinLogMessage;
+
+/*
+    Arguments are encoded in the order the format string consumes them:
+        kBinArgInt      8 bytes, already truncated/extended per the length modifier
+        kBinArgDouble   8 bytes (long doubles lose precision)
+        kBinArgString   uint16_t length, then the text (not terminated), cut
+                        short at the conversion's precision if it has one
+        kBinArgErrno    8 bytes, the value of errno when the message was logged
+    '*' widths and precisions are consumed as kBinArgInt.
+ */
+typedef enum {
+    kBinArgNone,                /* no argument, e.g. %% */
+    kBinArgInt,
+    kBinArgUnsigned,            /* encoded exactly like kBinArgInt */
+    kBinArgDouble,
+    kBinArgPointer,             /* encoded exactly like kBinArgInt */
+    kBinArgString,
+    kBinArgErrno                /* %m - the writer's errno, encoded like kBinArgInt */
+} eBinLogArg;
+
+typedef enum {
+    kBinLenInt, kBinLenChar, kBinLenShort, kBinLenLong, kBinLenLongLong,
+    kBinLenIntMax, kBinLenSize, kBinLenPtrDiff, kBinLenLongDouble
+} eBinLogLength;
+
+/* one printf conversion, as found by _binLogNextConversion() */
+typedef struct {
+    const char     *start;          /* the '%' */
+    const char     *end;            /* one past the conversion character */
+    eBinLogArg      arg;
+    eBinLogLength   length;
+    int             starWidth;      /* width is '*', consumes an extra int */
+    int             starPrecision;  /* precision is '*', consumes an extra int */
+    int             precision;      /* a precision given as digits, or -1 */
+    char            conversion;
+} tBinLogConversion;
+
+/* find the next conversion in format. Returns NULL when there are none left,
+   otherwise the position following it. Used by both the writer and the reader,
+   so they agree on which arguments are present */
+const char *_binLogNextConversion( const char *format, tBinLogConversion *conv )
+                            __attribute__((no_instrument_function));
+
+#endif
@@ -77,12 +77,10 @@ tMACaddr parseMAC( const char *text, int len )
     return result;
 }
 
-char *MACtoString( tMACaddr macAddr )
+char *MACtoBuffer( tMACaddr macAddr, char *buffer )
 {
-    int len = 6 * 4; /* six bytes, requiring three characters each */
-    char *string = malloc( len );
+    char *p = buffer;
 
-    char *p = string;
     for ( int i = 44; i >= 0; i -= 4 )
     {
         *p++ = toHex[ (macAddr >> i) & 0xF ];
@@ -92,42 +90,68 @@ char *MACtoString( tMACaddr macAddr )
     --p;
     *p = '\0';
 
+    return buffer;
+}
+
+char *MACtoString( tMACaddr macAddr )
+{
+    char *string = malloc( kMACStringSize );
+
+    if ( string != NULL )
+    {
+        MACtoBuffer( macAddr, string );
+    }
     return string;
 }
 
-/*
- * debugging code to visually check what comes out matches what goes in (semantically)
- */
-char * assembleCompany( tCompanyIndex company )
+size_t assembleCompanyInto( tCompanyIndex company, char *buffer, size_t size )
 {
-    size_t length = 0;
-    char *name;
-    tCompanyIndex co;
+    size_t          length = 0, written = 0, wordLength;
+    const char     *word;
+    tCompanyIndex   co = company;
 
     int count = gCompaniesLen[company];
 
-    /* first, figure out how much space to malloc */
-    co = company;
+    /* the fragments in gBucket[], separated by spaces. What doesn't fit is
+       cut off at a word boundary, but still counted */
     for ( int i = 0; i < count; ++i )
     {
-        length += strlen( (char *)&gBuckets[gCompanies[co]] ) + 1; /* + 1 for trailing space */
+        word = (const char *)&gBuckets[gCompanies[co]];
+        wordLength = strlen( word ) + (i > 0);
+        if ( written == length && length + wordLength < size )
+        {
+            if ( i > 0 )
+                { buffer[written++] = ' '; }
+            memcpy( &buffer[written], word, wordLength - (i > 0) );
+            written += wordLength - (i > 0);
+        }
+        length += wordLength;
         ++co;
     }
+    if ( size > 0 )
+    {
+        buffer[written] = '\0';
+    }
+
+    return length;
+}
+
+/*
+ * debugging code to visually check what comes out matches what goes in (semantically)
+ */
+char * assembleCompany( tCompanyIndex company )
+{
+    size_t length;
+    char *name;
+
+    /* first, figure out how much space to malloc */
+    length = assembleCompanyInto( company, NULL, 0 );
 
     name = malloc( length + 1 );
     if (name != NULL)
     {
         /* reassemble the company string from the fragments in gBucket[] */
-        name[0] = '\0';
-        co = company;
-        for ( int i = 0; i < count; ++i )
-        {
-            strcat(name, (char *) &gBuckets[gCompanies[co]]);
-            strcat(name, " ");
-            ++co;
-        }
-        /* nuke the trailing space */
-        name[strlen(name) - 1] = '\0';
+        assembleCompanyInto( company, name, length + 1 );
     }
 
     return name;
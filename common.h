@@ -1,6 +1,8 @@
 /*
  */
 
+#include <stddef.h>
+
 #ifdef UNUSED
 #elif defined(__GNUC__)
 # define UNUSED(x) UNUSED_ ## x __attribute__((unused))
@@ -24,9 +26,17 @@ extern unsigned char   *gCompaniesLen;
 
 extern char             toHex[];
 
+#define kMACStringSize  18      /* "aa:bb:cc:dd:ee:ff" and the NUL */
+
 tMACaddr    parseMAC( const char *text, int len );
 char *      MACtoString( tMACaddr macAddr );
 char *      assembleCompany( tCompanyIndex company );
 
+/* the same, into the caller's buffer rather than a new one. MACtoBuffer()
+   needs kMACStringSize chars. assembleCompanyInto() returns the length of
+   the whole name, like snprintf(), so a return >= size means it was cut off */
+char *      MACtoBuffer( tMACaddr macAddr, char *buffer );
+size_t      assembleCompanyInto( tCompanyIndex company, char *buffer, size_t size );
+
 void        mapDatabase(void);
 void        unmapDatabase(void);
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <unistd.h>
 
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
 #include <popt.h>       /* popt library for parsing config files and command line options */
@@ -10,17 +11,46 @@
 
 #include "logging.h"
 #include "common.h"
+#include "pool.h"
 
 /* static data */
 
-static tConfigOptions  configOptions = {
+static const tConfigOptions  kConfigDefaults = {
     kLogNotice,
     NULL,
     NULL,
     0,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    0,
+    NULL,
+    NULL,
+    0,
+    NULL,
+    0,
+    NULL,
+    0,
+    0,
+    NULL,
+    NULL,
+    NULL,
+    { 0 },
+    0,
+    0,
     NULL
 };
 
+/* popt parses into this, then it's copied out into a snapshot */
+static tConfigOptions  configOptions;
+
+/* popt doesn't free a string option's earlier value when it's given again
+   (in the config file, then on the command line), so string options come
+   back to parseOptions() to store, with a val that says which field */
+#define kStringOption           0x1000
+#define stringOption( field )   (kStringOption + (int)offsetof( tConfigOptions, field ))
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
 
@@ -28,9 +58,27 @@ static tConfigOptions  configOptions = {
 static struct poptOption optionsVocab[] =
 {
     /* longName, shortName, argInfo, arg, val, autohelp, autohelp arg */
-    { "config",  'c', POPT_ARG_STRING, &configOptions.configFile, 1, "read Configuration from <file>",              "path to file" },
-    { "logfile", 'l', POPT_ARG_STRING, &configOptions.logFile,    0, "send logging to <file>",                      "path to file" },
+    { "config",  'c', POPT_ARG_STRING, NULL, stringOption( configFile ), "read Configuration from <file>",              "path to file" },
+    { "logfile", 'l', POPT_ARG_STRING, NULL, stringOption( logFile ), "send logging to <file>",                      "path to file" },
     { "debug",   'd', POPT_ARG_INT,    &configOptions.debugLevel, 0, "set the amount of logging (syslog priority)", "debug level"  },
+    { "binlog",  'b', POPT_ARG_NONE,   &configOptions.binaryLog,  0, "write the logfile in binary (read it with fflogdump)", NULL },
+    { "trace",   '\0', POPT_ARG_STRING, NULL, stringOption( traceFile ), "write a Chrome/Perfetto trace of function calls to <file> ('make trace' builds)", "path to file" },
+    { "profile", '\0', POPT_ARG_STRING, NULL, stringOption( profileFile ), "write a flat/call-graph profile to <file> at exit or on SIGUSR2 ('make trace' builds)", "path to file" },
+    { "statsfile", '\0', POPT_ARG_STRING, NULL, stringOption( statsFile ), "publish live per-stage stats to <file>", "path to file" },
+    { "stats",   '\0', POPT_ARG_STRING, NULL, stringOption( readStats ), "print the stats a running (or finished) fftest is publishing to <file>", "path to file" },
+    { "nodedupe", '\0', POPT_ARG_NONE,  &configOptions.noDedupe, 0, "probe every path, even hardlinks and identical copies of files already probed", NULL },
+    { "store",   '\0', POPT_ARG_STRING, NULL, stringOption( storeFile ), "also write the results to a columnar store, for 'fftest query <file> ...'", "path to file" },
+    { "shard",   '\0', POPT_ARG_STRING, NULL, stringOption( shard ), "only probe the paths in shard i of N (by a hash of the path)", "i/N" },
+    { "merge",   '\0', POPT_ARG_NONE,   &configOptions.merge,    0, "merge the outputs of several shards, sorted by path", NULL },
+    { "files-from", '\0', POPT_ARG_STRING, NULL, stringOption( filesFrom ), "read the paths to probe from <file>, or - for stdin, probing as they arrive", "path to file" },
+    { "null",    '0', POPT_ARG_NONE,    &configOptions.nullInput, 0, "--files-from paths are NUL-separated (find -print0)", NULL },
+    { "jobs",    'j', POPT_ARG_STRING, NULL, stringOption( jobs ), "probe with <N> worker threads, or let the count adapt to the load", "N|auto" },
+    { "latency-ceiling", '\0', POPT_ARG_INT, &configOptions.latencyCeiling, 0, "--jobs auto: shrink when the p90 per-file time goes over <ms>", "ms" },
+    { "load-ceiling", '\0', POPT_ARG_INT, &configOptions.loadCeiling,    0, "--jobs auto: shrink when the CPUs are busier than <percent>", "percent" },
+    { "device-video", '\0', POPT_ARG_STRING, NULL, stringOption( deviceVideo ), "the video the device plays: codec:WxH:depth, ... (longer x shorter side)", "h264:4096x2304:8,..." },
+    { "device-audio", '\0', POPT_ARG_STRING, NULL, stringOption( deviceAudio ), "the audio codecs the device plays", "aac,mp3,..." },
+    { "device-containers", '\0', POPT_ARG_STRING, NULL, stringOption( deviceContainers ), "the containers the device plays (demuxer names), others need a remux", "mov,..." },
+    { "logctl",  '\0', POPT_ARG_INT,   &configOptions.controlPid, 0, "change the log settings of a running process, e.g. config=debug trace=on", "pid" },
     POPT_AUTOHELP
     POPT_TABLEEND
 };
@@ -63,24 +111,32 @@ int fileIsReadable( const char * file, int errIfMissing )
     return !notReadable;
 }
 
-#define ARGV_SIZE   200
-
-int parseConfigFile( poptContext context, const char * configFile )
+/*
+    Read a config file into argv-style options ("key value" becomes
+    "--key value"), for popt to parse ahead of the command line. The
+    caller frees *fileArgv with freeArgv()
+*/
+int parseConfigFile( const char * configFile, int *fileArgc, char ***fileArgv )
 {
     int             result;
     int             len;
     FILE           *confFD;
-    char           *first, *key, *value, *saved;
+    char           *key, *value, *saved;
     char            line[1024];
-    int             argc;
+    int             argc, allocated;
     char          **argv;
 
     result = 0;
 
     argc = 0;
-    argv = calloc( ARGV_SIZE, sizeof( char * ) );
+    allocated = 0;
+    argv = NULL;
 
-    if ( fileIsReadable( configFile, 1 ) )
+    if ( !fileIsReadable( configFile, 1 ) )
+    {
+        result = ENOENT;
+    }
+    else
     {
         confFD = fopen( configFile, "r" );
         if (confFD == NULL)
@@ -90,68 +146,105 @@ int parseConfigFile( poptContext context, const char * configFile )
         }
         else
         {
-            while ( fgets( line, sizeof( line ), confFD ) != NULL && !feof( confFD ) )
+            while ( fgets( line, sizeof( line ), confFD ) != NULL )
             {
-                /* skip forward to the first non-whitespace character */
-                first = strtok_r( line, " \t\n\r", &saved );
-                switch ( *first )
+                /* the first word is the key, the next (after whitespace or '=') is the value */
+                key   = strtok_r( line, "= \t\n\r", &saved );
+                if ( key == NULL || *key == '#' )
                 {
-                case '\0': /* blank line (only whitespace) */
-                case '#':  /* comment line */
-                    break;
-
-                default:
-                    /* split each line */
-                    key   = strtok_r( NULL, "= \t\n\r", &saved );
-                    value = strtok_r( NULL, "= \t\n\r", &saved );
-
-#if 0
-                    logDebug( "key: \"%s\", value: \"%s\"",
-                               key   != NULL ? key   : "(null)",
-                               value != NULL ? value : "(null)" );
-#endif
-
-                    /* add to argv */
-                    if ( key != NULL )
-                    {
-                        len = strlen( key + 2 + 1 );
-                        argv[argc] = malloc( len );
-                        if (argv[argc] != NULL)
-                        {
-                            snprintf( argv[argc], len, "--%s", key );
-                            ++argc;
-                        }
-                    }
-                    if ( value != NULL )
+                    /* blank line (only whitespace) or comment line */
+                    continue;
+                }
+                value = strtok_r( NULL, "= \t\n\r", &saved );
+
+                /* room for the key, the value and the NULL at the end */
+                if ( argc + 3 > allocated )
+                {
+                    allocated = (allocated == 0) ? 32 : allocated * 2;
+                    argv = realloc( argv, allocated * sizeof( char * ) );
+                    if ( argv == NULL )
                     {
-                        argv[argc] = strdup( value );
-                        if (argv[argc] != NULL)
-                            { ++argc; }
+                        logError( "out of memory" );
+                        exit( __LINE__ );
                     }
-                    break;
+                }
+
+                /* add to argv */
+                len = strlen( key ) + 2 + 1;
+                argv[argc] = malloc( len );
+                if (argv[argc] != NULL)
+                {
+                    snprintf( argv[argc], len, "--%s", key );
+                    ++argc;
+                }
+                if ( value != NULL )
+                {
+                    argv[argc] = strdup( value );
+                    if (argv[argc] != NULL)
+                        { ++argc; }
                 }
                 argv[argc] = NULL;
             }
             result = ferror( confFD );
-
-            if (result == 0)
-            {
-                result = poptStuffArgs( context, (const char **)argv );
-            }
+            fclose( confFD );
         }
     }
 
+    *fileArgc = argc;
+    *fileArgv = argv;
+
     return result;
 }
 
-static int seenConfigFile = 0;
+static void freeArgv( int argc, char **argv )
+{
+    if ( argv != NULL )
+    {
+        for ( int i = 0; i < argc; ++i )
+        {
+            free( argv[i] );
+        }
+        free( argv );
+    }
+}
 
-tConfigOptions * parseConfiguration( int argc, const char *argv[] )
+/* free the strings popt and parseOptions() allocated */
+static void clearOptions( tConfigOptions *config )
+{
+    free( config->configFile );
+    free( config->logFile );
+    free( config->traceFile );
+    free( config->profileFile );
+    free( config->statsFile );
+    free( config->readStats );
+    free( config->storeFile );
+    free( config->shard );
+    free( config->filesFrom );
+    free( config->jobs );
+    free( config->deviceVideo );
+    free( config->deviceAudio );
+    free( config->deviceContainers );
+    freeArgv( config->argc, (char **)config->argv );
+    *config = kConfigDefaults;
+}
+
+static void freeConfiguration( tConfigOptions *config )
+{
+    if ( config != NULL )
+    {
+        clearOptions( config );
+        free( config );
+    }
+}
+
+/* run popt over argv, into configOptions. Returns 0 on success */
+static int parseOptions( int argc, const char *argv[], int reportErrors )
 {
     int result;
     poptContext context;
-    const char *path;
+    const char **args;
     const char **argvCopy;
+    char **field;
     int i;
 
     context = poptInit( argc, argv, optionsVocab, NULL );
@@ -159,64 +252,231 @@ tConfigOptions * parseConfiguration( int argc, const char *argv[] )
     if ( context == NULL )
     {
         logError( "failed to get a context to parse the command line" );
+        return -1;
     }
-    else
+
+    while ( (result = poptGetNextOpt( context )) >= 0 )
     {
-        while ( (result = poptGetNextOpt( context )) >= 0 )
+        if ( result >= kStringOption )
         {
-            switch (result)
-            {
-            case 1:
-                if (!seenConfigFile)
-                {
-                    path = poptGetOptArg( context );
-                    /* attempt to parse the config file */
-                    parseConfigFile( context, path );
-                    /* start over, command line options always take precedence */
-                    poptResetContext( context );
-                    /* remember that we did this already, resetting
-                     * the context means we'll be called again */
-                    seenConfigFile = 1;
-                }
-                break;
-
-            default:
-                break;
-            }
+            /* the last one given wins */
+            field = (char **)((char *)&configOptions + (result - kStringOption));
+            free( *field );
+            *field = poptGetOptArg( context );
         }
+    }
 
-        if (result < -1)
+    if (result < -1)
+    {
+        if ( reportErrors )
         {
             logError( "problem with a command line option \"%s\" (%s)",
                        poptBadOption( context, POPT_BADOPTION_NOALIAS ),
                        poptStrerror( result ) );
         }
-        else
-        {
-            argv = poptGetArgs( context );
-
-            argc = 0;
-            if (argv != NULL) {
-                while (argv[argc] != NULL) { ++argc; }
+    }
+    else
+    {
+        args = poptGetArgs( context );
 
-                if (argc > 0) {
-                    argvCopy = calloc(argc + 1, sizeof(char *));
+        argc = 0;
+        if (args != NULL) {
+            while (args[argc] != NULL) { ++argc; }
 
-                    if (argvCopy != NULL) {
-                        for (i = 0; i < argc; ++i) {
-                            argvCopy[i] = strdup(argv[i]);
-                        }
-                        argvCopy[i] = NULL;
+            if (argc > 0) {
+                argvCopy = calloc(argc + 1, sizeof(char *));
 
-                        configOptions.argc = argc;
-                        configOptions.argv = argvCopy;
+                if (argvCopy != NULL) {
+                    for (i = 0; i < argc; ++i) {
+                        argvCopy[i] = strdup(args[i]);
                     }
+                    argvCopy[i] = NULL;
+
+                    configOptions.argc = argc;
+                    configOptions.argv = argvCopy;
                 }
             }
         }
+        result = 0;
+    }
+
+    poptFreeContext( context );
+
+    return result;
+}
+
+/*
+    Parse the command line, and the config file it names, into a new
+    snapshot. The config file's options go in front of the command line's,
+    so the command line always takes precedence. *result is non-zero if
+    either had a problem (the snapshot has what could be parsed)
+*/
+static tConfigOptions * parseSnapshot( int argc, const char *argv[], int *result )
+{
+    tConfigOptions *snapshot;
+    char           *configFile;
+    int             fileArgc = 0;
+    char          **fileArgv = NULL;
+    const char    **allArgv;
+
+    /* a first pass, just to find the config file */
+    configOptions = kConfigDefaults;
+    parseOptions( argc, argv, 0 );
+    configFile = configOptions.configFile;
+    configOptions.configFile = NULL;
+    clearOptions( &configOptions );
+
+    *result = 0;
+    if ( configFile != NULL )
+    {
+        *result = parseConfigFile( configFile, &fileArgc, &fileArgv );
+        free( configFile );
+    }
+
+    allArgv = calloc( fileArgc + argc + 1, sizeof( char * ) );
+    snapshot = malloc( sizeof( tConfigOptions ) );
+    if ( allArgv == NULL || snapshot == NULL )
+    {
+        logError( "out of memory" );
+        exit( __LINE__ );
+    }
+    allArgv[0] = argv[0];
+    for ( int i = 0; i < fileArgc; ++i )
+        { allArgv[1 + i] = fileArgv[i]; }
+    for ( int i = 1; i < argc; ++i )
+        { allArgv[fileArgc + i] = argv[i]; }
+
+    if ( parseOptions( fileArgc + argc, allArgv, 1 ) != 0 )
+        { *result = -1; }
+
+    free( allArgv );
+    freeArgv( fileArgc, fileArgv );
+
+    *snapshot = configOptions;
+    configOptions = kConfigDefaults;
+
+    snapshot->device = kDefaultDevice;
+    if ( (snapshot->deviceVideo != NULL && parseDeviceVideo( snapshot->deviceVideo, &snapshot->device ) != 0)
+      || (snapshot->deviceAudio != NULL && parseDeviceAudio( snapshot->deviceAudio, &snapshot->device ) != 0)
+      || (snapshot->deviceContainers != NULL && parseDeviceContainers( snapshot->deviceContainers, &snapshot->device ) != 0) )
+    {
+        *result = -1;
+    }
+
+    return snapshot;
+}
+
+/*
+ * live reloading
+ *
+ * The current snapshot is published through gConfig and is never changed,
+ * only replaced. A reader (a pool worker, between files) announces the
+ * snapshot it's using in its own slot of gConfigInUse, and checks it's still
+ * the current one afterwards; a replaced snapshot is only freed once no slot
+ * names it. The first snapshot is kept for good - the scan's paths point
+ * into it.
+ */
+
+static int              gConfigArgc;
+static const char     **gConfigArgv;
+static tConfigOptions  *gConfig;
+static tConfigOptions  *gConfigFirst;
+static const tConfigOptions *gConfigInUse[kPoolMaxWorkers];
+static tConfigOptions **gConfigRetired;
+static int              gConfigRetiredCount;
+static int              gConfigReloadRequested;
+
+tConfigOptions * parseConfiguration( int argc, const char *argv[] )
+{
+    int result;
+
+    gConfigArgc = argc;
+    gConfigArgv = argv;
+
+    /* as ever, carry on with whatever could be parsed */
+    gConfigFirst = parseSnapshot( argc, argv, &result );
+    __atomic_store_n( &gConfig, gConfigFirst, __ATOMIC_SEQ_CST );
+
+    return gConfigFirst;
+}
+
+/* free the replaced snapshots that no reader is using any more */
+static void reclaimConfigurations( void )
+{
+    int kept = 0;
+    int inUse;
+
+    for ( int r = 0; r < gConfigRetiredCount; ++r )
+    {
+        inUse = 0;
+        for ( int i = 0; i < kPoolMaxWorkers && !inUse; ++i )
+        {
+            inUse = (__atomic_load_n( &gConfigInUse[i], __ATOMIC_SEQ_CST ) == gConfigRetired[r]);
+        }
+        if ( inUse )
+            { gConfigRetired[kept++] = gConfigRetired[r]; }
+        else
+            { freeConfiguration( gConfigRetired[r] ); }
+    }
+    gConfigRetiredCount = kept;
+}
 
-        poptFreeContext( context );
+const tConfigOptions * reloadConfiguration( void )
+{
+    tConfigOptions *snapshot, *old;
+    int             result;
+
+    snapshot = parseSnapshot( gConfigArgc, gConfigArgv, &result );
+    if ( result != 0 )
+    {
+        logError( "reload failed, keeping the configuration we have" );
+        freeConfiguration( snapshot );
+        return NULL;
     }
 
-    return &configOptions;
+    old = __atomic_exchange_n( &gConfig, snapshot, __ATOMIC_SEQ_CST );
+
+    if ( old != gConfigFirst )
+    {
+        gConfigRetired = realloc( gConfigRetired, (gConfigRetiredCount + 1) * sizeof( tConfigOptions * ) );
+        if ( gConfigRetired == NULL )
+        {
+            logError( "out of memory" );
+            exit( __LINE__ );
+        }
+        gConfigRetired[gConfigRetiredCount++] = old;
+    }
+    reclaimConfigurations();
+
+    logNotice( "configuration reloaded%s%s", (snapshot->configFile != NULL) ? " from " : "",
+               (snapshot->configFile != NULL) ? snapshot->configFile : "" );
+
+    return snapshot;
+}
+
+const tConfigOptions * configAcquire( unsigned int reader )
+{
+    const tConfigOptions *config;
+
+    do {
+        config = __atomic_load_n( &gConfig, __ATOMIC_SEQ_CST );
+        __atomic_store_n( &gConfigInUse[reader], config, __ATOMIC_SEQ_CST );
+    } while ( config != __atomic_load_n( &gConfig, __ATOMIC_SEQ_CST ) );
+
+    return config;
+}
+
+void configRelease( unsigned int reader )
+{
+    __atomic_store_n( &gConfigInUse[reader], NULL, __ATOMIC_RELEASE );
+}
+
+void configReloadSignal( int UNUSED(signal) )
+{
+    __atomic_store_n( &gConfigReloadRequested, 1, __ATOMIC_RELEASE );
+}
+
+int configReloadRequested( void )
+{
+    return gConfigReloadRequested && __atomic_exchange_n( &gConfigReloadRequested, 0, __ATOMIC_ACQ_REL );
 }
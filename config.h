@@ -2,15 +2,54 @@
 #ifndef config_h
 #define config_h
 
+#include "device.h"
+
 typedef struct {
     int             debugLevel;     /* controls the amount of logging (syslog priority) */
     char           *configFile;     /* config file path, or NULL for default search */
     char           *logFile;        /* file destination for logs, or NULL if the user didn't supply one */
+    int             binaryLog;      /* non-zero to write logFile in the binary format (see fflogdump) */
+    char           *traceFile;      /* write a function trace here, or NULL (needs a 'make trace' build) */
+    char           *profileFile;    /* write a function profile here, or NULL (likewise) */
+    char           *statsFile;      /* publish live stats to this file, or NULL */
+    char           *readStats;      /* if not NULL, print the stats published to this file by another fftest, and exit */
+    int             noDedupe;       /* non-zero to probe every path, even hardlinks and copies of files already probed */
+    char           *storeFile;      /* also write the results to this columnar store (see 'fftest query'), or NULL */
+    char           *shard;          /* "i/N" to only probe the paths in shard i of N, or NULL for all of them */
+    int             merge;          /* non-zero to merge the shard outputs named by the parameters, and exit */
+    char           *filesFrom;      /* read the paths to probe from this file ("-" for stdin), or NULL */
+    int             nullInput;      /* non-zero if the filesFrom paths are NUL-separated, rather than one per line */
+    char           *jobs;           /* worker count, "auto" to adapt it to the load, or NULL for 1 */
+    int             latencyCeiling; /* auto: keep the p90 per-file time under this (ms), 0 for no limit */
+    int             loadCeiling;    /* auto: keep the CPUs less busy than this (percent), 0 for no limit */
+    char           *deviceVideo;    /* the device's video codecs and their limits (see parseDeviceVideo), or NULL for the default */
+    char           *deviceAudio;    /* the device's audio codecs, or NULL for the default */
+    char           *deviceContainers; /* the containers the device plays, or NULL for the default */
+    tDevice         device;         /* kDefaultDevice, with the three above applied */
+    int             controlPid;     /* if non-zero, send the remaining parameters to this process as log settings */
     int             argc;           /* count of the command line parameters that weren't consumed by popt */
     const char    **argv;           /* the command line parameters that weren't consumed by popt */
 
 } tConfigOptions;
 
+/* parse the command line (and the config file it names) at startup. The
+   result stays valid until exit */
 tConfigOptions * parseConfiguration(int argc, const char *argv[] );
 
+/* parse them again, and make that the current configuration. Only the
+   thread that called parseConfiguration() may call this. Returns the new
+   snapshot, valid until the next reload, or NULL (and the current one
+   stays) if there was a problem */
+const tConfigOptions * reloadConfiguration( void );
+
+/* the current configuration, for pool worker 'reader' to use until it
+   calls configRelease(). Call between files, not around the whole scan */
+const tConfigOptions * configAcquire( unsigned int reader );
+void             configRelease( unsigned int reader );
+
+/* SIGHUP: ask the main thread to call reloadConfiguration(), when
+   configReloadRequested() next returns non-zero */
+void             configReloadSignal( int signal );
+int              configReloadRequested( void );
+
 #endif
@@ -0,0 +1,228 @@
+/*
+    Probe-once deduplication.
+
+    Paths are grouped in two passes: first by (device, inode), which finds
+    hardlinks and symlinks for the cost of a stat(); then the survivors with
+    the same size are grouped by a hash of their first and last blocks, which
+    finds copies from different ingest paths (and reflinks). Only files that
+    share their size with another one are ever read, so a library with no
+    copies costs one stat() per path.
+
+    The content hash is a heuristic: two files that agree in size, head and
+    tail but differ in the middle would get the same verdict. For probing,
+    which only looks at the container's header and index, that is what we
+    want anyway.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "logging.h"
+#include "dedupe.h"
+
+#define kDedupeBlock    (64 * 1024)
+
+typedef struct {
+    int             index;          /* into the caller's paths */
+    dev_t           dev;
+    ino_t           ino;
+    off_t           size;
+    uint64_t        hash;           /* of the head & tail, only if the size isn't unique */
+} tDedupeEntry;
+
+static int _byInode( const void *a, const void *b )
+{
+    const tDedupeEntry *x = a, *y = b;
+
+    if ( x->dev != y->dev ) return (x->dev < y->dev) ? -1 : 1;
+    if ( x->ino != y->ino ) return (x->ino < y->ino) ? -1 : 1;
+    return x->index - y->index;
+}
+
+static int _bySize( const void *a, const void *b )
+{
+    const tDedupeEntry *x = a, *y = b;
+
+    if ( x->size != y->size ) return (x->size < y->size) ? -1 : 1;
+    return x->index - y->index;
+}
+
+static int _byHash( const void *a, const void *b )
+{
+    const tDedupeEntry *x = a, *y = b;
+
+    if ( x->hash != y->hash ) return (x->hash < y->hash) ? -1 : 1;
+    return x->index - y->index;
+}
+
+/* a fast, non-cryptographic 64 bit hash, a word at a time */
+static uint64_t _hashBlock( uint64_t hash, const unsigned char *data, size_t length )
+{
+    uint64_t word;
+    size_t   i;
+
+    for ( i = 0; i + sizeof( word ) <= length; i += sizeof( word ) )
+    {
+        memcpy( &word, &data[i], sizeof( word ) );
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 29;
+    }
+    for ( ; i < length; ++i )
+    {
+        hash = (hash ^ data[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+/* hash the first and last blocks of a file. Returns 0 on success */
+static int _hashFile( const char *path, off_t size, uint64_t *hash )
+{
+    unsigned char   buffer[kDedupeBlock];
+    ssize_t         count;
+    off_t           tail;
+    int             fd;
+
+    fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd == -1 )
+    {
+        logDebug( "unable to open \"%s\" (%d: %s)", path, errno, strerror( errno ) );
+        return -1;
+    }
+
+    *hash = _hashBlock( 0xCBF29CE484222325ULL, (const unsigned char *)&size, sizeof( size ) );
+
+    count = pread( fd, buffer, sizeof( buffer ), 0 );
+    if ( count > 0 )
+    {
+        *hash = _hashBlock( *hash, buffer, count );
+
+        tail = size - kDedupeBlock;
+        if ( tail > count )
+        {
+            /* don't re-read (or overlap) the head */
+            count = pread( fd, buffer, sizeof( buffer ), tail );
+            if ( count > 0 )
+            {
+                *hash = _hashBlock( *hash, buffer, count );
+            }
+        }
+        else if ( tail > 0 )
+        {
+            count = pread( fd, buffer, size - count, count );
+            if ( count > 0 )
+            {
+                *hash = _hashBlock( *hash, buffer, count );
+            }
+        }
+    }
+    if ( count < 0 )
+    {
+        logDebug( "unable to read \"%s\" (%d: %s)", path, errno, strerror( errno ) );
+    }
+    close( fd );
+
+    return (count < 0) ? -1 : 0;
+}
+
+int dedupePaths( const char *paths[], int count, int representative[] )
+{
+    tDedupeEntry   *entries;
+    struct stat     st;
+    int             entryCount = 0;
+    int             unique, linked = 0, copied = 0;
+    int             i, j, k;
+
+    for ( i = 0; i < count; ++i )
+    {
+        representative[i] = i;
+    }
+
+    entries = malloc( count * sizeof( tDedupeEntry ) );
+    if ( entries == NULL )
+    {
+        logError( "out of memory, probing every path" );
+        return count;
+    }
+
+    /* only regular files are candidates; anything else gets probed (and reported) as-is */
+    for ( i = 0; i < count; ++i )
+    {
+        if ( stat( paths[i], &st ) == 0 && S_ISREG( st.st_mode ) )
+        {
+            entries[entryCount].index = i;
+            entries[entryCount].dev   = st.st_dev;
+            entries[entryCount].ino   = st.st_ino;
+            entries[entryCount].size  = st.st_size;
+            entries[entryCount].hash  = 0;
+            ++entryCount;
+        }
+    }
+
+    /* pass 1: the same inode. Keep the first path of each, drop the rest */
+    qsort( entries, entryCount, sizeof( tDedupeEntry ), _byInode );
+    for ( i = 0, j = 0; i < entryCount; ++i )
+    {
+        if ( j > 0 && entries[i].dev == entries[j - 1].dev && entries[i].ino == entries[j - 1].ino )
+        {
+            representative[entries[i].index] = entries[j - 1].index;
+            ++linked;
+        }
+        else
+        {
+            entries[j++] = entries[i];
+        }
+    }
+    entryCount = j;
+
+    /* pass 2: the same size, then the same head & tail */
+    qsort( entries, entryCount, sizeof( tDedupeEntry ), _bySize );
+    for ( i = 0; i < entryCount; i = j )
+    {
+        for ( j = i + 1; j < entryCount && entries[j].size == entries[i].size; ++j )
+            { }
+        if ( j - i < 2 )
+        {
+            continue;   /* a unique size can't have a copy */
+        }
+
+        for ( k = i; k < j; ++k )
+        {
+            if ( _hashFile( paths[entries[k].index], entries[k].size, &entries[k].hash ) != 0 )
+            {
+                /* unreadable: give it a hash nothing else will have */
+                entries[k].hash = ~(uint64_t)entries[k].index;
+            }
+        }
+        qsort( &entries[i], j - i, sizeof( tDedupeEntry ), _byHash );
+        for ( k = i + 1; k < j; ++k )
+        {
+            if ( entries[k].hash == entries[k - 1].hash )
+            {
+                /* sorted by index within a hash, so k - 1 has the group's representative */
+                representative[entries[k].index] = representative[entries[k - 1].index];
+                ++copied;
+            }
+        }
+    }
+
+    free( entries );
+
+    /* a hardlink's representative may itself be a copy of an earlier file.
+       Representatives always come first, so one pass in order resolves it */
+    for ( i = 0; i < count; ++i )
+    {
+        representative[i] = representative[representative[i]];
+    }
+
+    unique = count - linked - copied;
+    logInfo( "%d paths, %d distinct files (%d hardlinked, %d copies)", count, unique, linked, copied );
+
+    return unique;
+}
@@ -0,0 +1,17 @@
+/*
+    finding paths that are the same file, or a byte-identical copy of one,
+    so that only one of them needs to be probed
+*/
+
+#ifndef DEDUPE_H
+#define DEDUPE_H
+
+/* for each of the count paths, set representative[i] to the index of the
+   first path that is the same file (hardlink, or a symlink to it) or looks
+   like an identical copy (same size, same hash of the first and last 64K -
+   which covers reflinks too). representative[i] == i for a path that is the
+   first of its group, or that can't be stat()ed. Returns the number of
+   distinct files, i.e. the number of probes needed. */
+int     dedupePaths( const char *paths[], int count, int representative[] );
+
+#endif
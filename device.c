@@ -0,0 +1,247 @@
+/*
+    The device policy: given what probeFile() found in a file, will it play
+    on the target device as-is, does it only need remuxing into a container
+    the device takes, or does a stream have to be transcoded.
+
+    Kept apart from probe.c, so the probing doesn't depend on any one
+    device's limits.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+
+#include "common.h"
+#include "logging.h"
+#include "device.h"
+
+const tDevice kDefaultDevice = {
+    .videoCount = 3,
+    .video = {
+        { AV_CODEC_ID_H264,  4096, 2304,  8 },
+        { AV_CODEC_ID_HEVC,  4096, 2304, 10 },
+        { AV_CODEC_ID_MPEG4,  640,  480,  8 },
+    },
+    .audioCount = 6,
+    .audio = {
+        AV_CODEC_ID_AAC,
+        AV_CODEC_ID_ALAC,
+        AV_CODEC_ID_AC3,
+        AV_CODEC_ID_EAC3,
+        AV_CODEC_ID_MP3,
+        AV_CODEC_ID_PCM_S16LE,
+    },
+    .containerCount = 1,
+    .containers = {
+        "mov",      /* also mp4, m4v, m4a */
+    },
+};
+
+/* the codec of this type called name, or AV_CODEC_ID_NONE */
+static int _codec( const char *name, enum AVMediaType type )
+{
+    const AVCodecDescriptor *descriptor = avcodec_descriptor_get_by_name( name );
+
+    return (descriptor != NULL && descriptor->type == type) ? (int)descriptor->id : AV_CODEC_ID_NONE;
+}
+
+/* a writable copy of a comma separated list, for strtok_r() */
+static char *_copyList( const char *text, const char *what )
+{
+    char *copy;
+
+    if ( text == NULL || *text == '\0' )
+    {
+        logError( "the device's %s can't be empty", what );
+        return NULL;
+    }
+    copy = strdup( text );
+    if ( copy == NULL )
+    {
+        logError( "out of memory" );
+        exit( __LINE__ );
+    }
+    return copy;
+}
+
+int parseDeviceVideo( const char *text, tDevice *device )
+{
+    tVideoLimit     limits[kDeviceMaxCodecs];
+    unsigned int    count = 0;
+    char           *list, *item, *saved, name[32];
+    int             length = 0;
+    int             result = 0;
+
+    list = _copyList( text, "video codecs" );
+    if ( list == NULL )
+    {
+        return -1;
+    }
+    for ( item = strtok_r( list, ",", &saved ); item != NULL && result == 0; item = strtok_r( NULL, ",", &saved ) )
+    {
+        if ( count == kDeviceMaxCodecs )
+        {
+            logError( "a device can have at most %d video codecs", kDeviceMaxCodecs );
+            result = -1;
+        }
+        else if ( sscanf( item, "%31[^:]:%dx%d:%d%n", name, &limits[count].maxWidth, &limits[count].maxHeight,
+                          &limits[count].maxBitDepth, &length ) != 4 || item[length] != '\0' )
+        {
+            logError( "\"%s\" isn't a video limit - expected codec:WxH:depth, e.g. h264:4096x2304:8", item );
+            result = -1;
+        }
+        else if ( (limits[count].codec = _codec( name, AVMEDIA_TYPE_VIDEO )) == AV_CODEC_ID_NONE )
+        {
+            logError( "\"%s\" isn't a video codec FFmpeg knows", name );
+            result = -1;
+        }
+        else
+        {
+            ++count;
+        }
+    }
+    free( list );
+
+    if ( result == 0 )
+    {
+        memcpy( device->video, limits, count * sizeof( tVideoLimit ) );
+        device->videoCount = count;
+    }
+    return result;
+}
+
+int parseDeviceAudio( const char *text, tDevice *device )
+{
+    int             codecs[kDeviceMaxCodecs];
+    unsigned int    count = 0;
+    char           *list, *item, *saved;
+    int             result = 0;
+
+    list = _copyList( text, "audio codecs" );
+    if ( list == NULL )
+    {
+        return -1;
+    }
+    for ( item = strtok_r( list, ",", &saved ); item != NULL && result == 0; item = strtok_r( NULL, ",", &saved ) )
+    {
+        if ( count == kDeviceMaxCodecs )
+        {
+            logError( "a device can have at most %d audio codecs", kDeviceMaxCodecs );
+            result = -1;
+        }
+        else if ( (codecs[count] = _codec( item, AVMEDIA_TYPE_AUDIO )) == AV_CODEC_ID_NONE )
+        {
+            logError( "\"%s\" isn't an audio codec FFmpeg knows", item );
+            result = -1;
+        }
+        else
+        {
+            ++count;
+        }
+    }
+    free( list );
+
+    if ( result == 0 )
+    {
+        memcpy( device->audio, codecs, count * sizeof( int ) );
+        device->audioCount = count;
+    }
+    return result;
+}
+
+int parseDeviceContainers( const char *text, tDevice *device )
+{
+    char            containers[kDeviceMaxContainers][16];
+    unsigned int    count = 0;
+    char           *list, *item, *saved;
+    int             result = 0;
+
+    list = _copyList( text, "containers" );
+    if ( list == NULL )
+    {
+        return -1;
+    }
+    for ( item = strtok_r( list, ",", &saved ); item != NULL && result == 0; item = strtok_r( NULL, ",", &saved ) )
+    {
+        if ( count == kDeviceMaxContainers )
+        {
+            logError( "a device can have at most %d containers", kDeviceMaxContainers );
+            result = -1;
+        }
+        else if ( strlen( item ) >= sizeof( containers[0] ) )
+        {
+            logError( "\"%s\" is too long for a demuxer name", item );
+            result = -1;
+        }
+        else
+        {
+            strcpy( containers[count++], item );
+        }
+    }
+    free( list );
+
+    if ( result == 0 )
+    {
+        memcpy( device->containers, containers, count * sizeof( containers[0] ) );
+        device->containerCount = count;
+    }
+    return result;
+}
+
+eVerdict deviceVerdict( const tDevice *device, const tProbeResult *result )
+{
+    const tVideoLimit  *limit = NULL;
+    int                 longer, shorter;
+    unsigned int        i;
+
+    if ( result->videoCodec == AV_CODEC_ID_NONE && result->audioCodec == AV_CODEC_ID_NONE )
+    {
+        return kVerdictError;
+    }
+
+    if ( result->videoCodec != AV_CODEC_ID_NONE )
+    {
+        for ( i = 0; i < device->videoCount && limit == NULL; ++i )
+        {
+            if ( device->video[i].codec == result->videoCodec )
+            {
+                limit = &device->video[i];
+            }
+        }
+        longer  = (result->width > result->height) ? result->width  : result->height;
+        shorter = (result->width > result->height) ? result->height : result->width;
+        if ( limit == NULL
+          || longer > limit->maxWidth || shorter > limit->maxHeight
+          || result->bitDepth > limit->maxBitDepth )
+        {
+            return kVerdictTranscode;
+        }
+    }
+
+    if ( result->audioCodec != AV_CODEC_ID_NONE )
+    {
+        for ( i = 0; i < device->audioCount; ++i )
+        {
+            if ( device->audio[i] == result->audioCodec )
+            {
+                break;
+            }
+        }
+        if ( i == device->audioCount )
+        {
+            return kVerdictTranscode;
+        }
+    }
+
+    for ( i = 0; i < device->containerCount; ++i )
+    {
+        if ( strcmp( device->containers[i], result->container ) == 0 )
+        {
+            return kVerdictPlayable;
+        }
+    }
+
+    return kVerdictRemux;
+}
@@ -0,0 +1,44 @@
+/*
+    what the target device can play, and the verdict on a probed file
+*/
+
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include "probe.h"
+
+#define kDeviceMaxCodecs        16
+#define kDeviceMaxContainers    8
+
+typedef struct {
+    int             codec;          /* enum AVCodecID */
+    int             maxWidth;       /* of the longer side */
+    int             maxHeight;      /* of the shorter side */
+    int             maxBitDepth;
+} tVideoLimit;
+
+/* fixed size, so it can be copied (or kept in a configuration) as is */
+typedef struct {
+    unsigned int    videoCount;
+    unsigned int    audioCount;
+    unsigned int    containerCount;
+    tVideoLimit     video[kDeviceMaxCodecs];
+    int             audio[kDeviceMaxCodecs];            /* enum AVCodecID */
+    char            containers[kDeviceMaxContainers][16];   /* demuxer short names */
+} tDevice;
+
+/* an iPhone/iPad */
+extern const tDevice kDefaultDevice;
+
+/* replace the device's video limits, audio codecs or containers with a
+   comma separated list, e.g. "h264:4096x2304:8,hevc:4096x2304:10" (codec,
+   longer x shorter side, bit depth), "aac,mp3" and "mov,matroska" (codec
+   and demuxer names as FFmpeg has them). Returns 0 on success */
+int             parseDeviceVideo( const char *text, tDevice *device );
+int             parseDeviceAudio( const char *text, tDevice *device );
+int             parseDeviceContainers( const char *text, tDevice *device );
+
+/* playable, remux or transcode, for a file probeFile() could analyse */
+eVerdict        deviceVerdict( const tDevice *device, const tProbeResult *result );
+
+#endif
@@ -0,0 +1,290 @@
+/*
+    Throughput benchmark: probes every file in a corpus made by mkcorpus,
+    through the same probeFile() as fftest (the device's verdict, which
+    does no I/O, is left out), and reports
+
+        files/sec, bytes read per file, syscalls per file,
+        and the p50/p99/p99.9 latency of a single probe
+
+    for the whole corpus, and for each kind of file in it.
+
+    usage: ffbench [-n <passes>] [-c] <corpus directory>
+        -n  probe the corpus this many times (default 3). The first pass
+            warms the page cache, and is not counted unless -c is given
+        -c  cold: drop each file from the page cache before probing it
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "common.h"
+#include "logging.h"
+#include "probe.h"
+
+const char *  gExecName;  /* base name of the executable, derived from argv[0] */
+
+typedef struct {
+    char           *kind;
+    char           *path;
+} tEntry;
+
+typedef struct {
+    const char     *kind;           /* NULL for the overall totals */
+    size_t          count;
+    size_t          errors;
+    uint64_t        bytesRead;
+    uint64_t        syscalls;
+    double          seconds;
+    double         *latencies;      /* one per probe, in seconds */
+} tTally;
+
+static double now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compareDoubles( const void *a, const void *b )
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* nearest-rank percentile of a sorted array */
+static double percentile( const double *sorted, size_t count, double p )
+{
+    size_t rank;
+
+    if ( count == 0 )
+    {
+        return 0;
+    }
+    rank = (size_t)(p / 100.0 * count + 0.999999);
+    if ( rank < 1 )
+    {
+        rank = 1;
+    }
+    return sorted[((rank <= count) ? rank : count) - 1];
+}
+
+static tEntry *readManifest( const char *directory, size_t *count )
+{
+    char        path[1024];
+    char       *line = NULL;
+    size_t      size = 0, allocated = 0;
+    ssize_t     length;
+    tEntry     *entries = NULL;
+    char       *tab;
+    FILE       *file;
+
+    snprintf( path, sizeof( path ), "%s/MANIFEST.tsv", directory );
+    file = fopen( path, "r" );
+    if ( file == NULL )
+    {
+        logError( "unable to open \"%s\" (%d: %s) - run mkcorpus first", path, errno, strerror( errno ) );
+        exit( __LINE__ );
+    }
+
+    *count = 0;
+    while ( (length = getline( &line, &size, file )) > 0 )
+    {
+        if ( line[length - 1] == '\n' )
+        {
+            line[length - 1] = '\0';
+        }
+        tab = strchr( line, '\t' );
+        if ( tab == NULL )
+        {
+            continue;
+        }
+        *tab = '\0';
+
+        if ( *count == allocated )
+        {
+            allocated = (allocated == 0) ? 256 : allocated * 2;
+            entries = realloc( entries, allocated * sizeof( tEntry ) );
+            if ( entries == NULL )
+            {
+                logError( "out of memory" );
+                exit( __LINE__ );
+            }
+        }
+        entries[*count].kind = strdup( line );
+        entries[*count].path = strdup( tab + 1 );
+        ++*count;
+    }
+    free( line );
+    fclose( file );
+
+    return entries;
+}
+
+static tTally *tallyFor( tTally *tallies, size_t *tallyCount, const char *kind, size_t capacity )
+{
+    size_t i;
+
+    for ( i = 1; i < *tallyCount; ++i )
+    {
+        if ( strcmp( tallies[i].kind, kind ) == 0 )
+        {
+            return &tallies[i];
+        }
+    }
+    tallies[i].kind      = kind;
+    tallies[i].latencies = calloc( capacity, sizeof( double ) );
+    ++*tallyCount;
+
+    return &tallies[i];
+}
+
+static void addProbe( tTally *tally, const tProbeResult *result, int err, double seconds )
+{
+    tally->latencies[tally->count++] = seconds;
+    tally->seconds   += seconds;
+    tally->bytesRead += result->bytesRead;
+    tally->syscalls  += result->syscalls;
+    if ( err != 0 )
+    {
+        ++tally->errors;
+    }
+}
+
+static void printTally( tTally *tally )
+{
+    double n = (tally->count > 0) ? tally->count : 1;
+
+    qsort( tally->latencies, tally->count, sizeof( double ), compareDoubles );
+
+    printf( "%-10s %7zu %6zu %10.1f %12.0f %9.1f %9.3f %9.3f %9.3f\n",
+            (tally->kind != NULL) ? tally->kind : "all",
+            tally->count, tally->errors,
+            (tally->seconds > 0) ? tally->count / tally->seconds : 0,
+            tally->bytesRead / n,
+            tally->syscalls / n,
+            percentile( tally->latencies, tally->count, 50 )   * 1e3,
+            percentile( tally->latencies, tally->count, 99 )   * 1e3,
+            percentile( tally->latencies, tally->count, 99.9 ) * 1e3 );
+}
+
+int main( int argc, char *argv[] )
+{
+    tEntry         *entries;
+    size_t          entryCount;
+    tTally         *tallies;
+    size_t          tallyCount = 1;
+    tProbeResult    result;
+    int             passes = 3, cold = 0;
+    int             opt, err, fd;
+    double          start, wall = 0;
+
+    gExecName = strrchr(argv[0], '/');
+    if (gExecName == NULL)
+        { gExecName = argv[0]; }
+    else
+        { ++gExecName; }
+
+    initLogging( gExecName );
+    startLogging( kLogWarning, NULL );
+
+    while ( (opt = getopt( argc, argv, "n:c" )) != -1 )
+    {
+        switch ( opt )
+        {
+        case 'n': passes = atoi( optarg ); break;
+        case 'c': cold = 1;                break;
+        default:
+            fprintf( stderr, "usage: %s [-n <passes>] [-c] <corpus directory>\n", gExecName );
+            return 1;
+        }
+    }
+    if ( optind != argc - 1 || passes < 1 )
+    {
+        fprintf( stderr, "usage: %s [-n <passes>] [-c] <corpus directory>\n", gExecName );
+        return 1;
+    }
+
+    entries = readManifest( argv[optind], &entryCount );
+    if ( entryCount == 0 )
+    {
+        logError( "the corpus in \"%s\" is empty", argv[optind] );
+        return 1;
+    }
+
+    /* before the warm-up, so every pass logs the same way */
+    initProbe();
+
+    /* the warm-up pass isn't counted, unless every pass is cold anyway */
+    if ( !cold && passes > 1 )
+    {
+        --passes;
+        for ( size_t i = 0; i < entryCount; ++i )
+        {
+            probeFile( entries[i].path, &result );
+        }
+    }
+
+    /* one overall tally, plus one per kind (there can't be more kinds than files) */
+    tallies = calloc( entryCount + 1, sizeof( tTally ) );
+    if ( tallies == NULL )
+    {
+        logError( "out of memory" );
+        return 1;
+    }
+    tallies[0].latencies = calloc( entryCount * passes, sizeof( double ) );
+
+    for ( int pass = 0; pass < passes; ++pass )
+    {
+        for ( size_t i = 0; i < entryCount; ++i )
+        {
+            if ( cold )
+            {
+                fd = open( entries[i].path, O_RDONLY );
+                if ( fd != -1 )
+                {
+                    fdatasync( fd );
+                    posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+                    close( fd );
+                }
+            }
+
+            start = now();
+            err = probeFile( entries[i].path, &result );
+            start = now() - start;
+            wall += start;
+
+            addProbe( &tallies[0], &result, err, start );
+            addProbe( tallyFor( tallies, &tallyCount, entries[i].kind, entryCount * passes ), &result, err, start );
+        }
+    }
+
+    printf( "%zu files x %d pass%s, %s cache, %.2f s\n\n",
+            entryCount, passes, (passes == 1) ? "" : "es", cold ? "cold" : "warm", wall );
+    printf( "%-10s %7s %6s %10s %12s %9s %9s %9s %9s\n",
+            "kind", "files", "errors", "files/sec", "bytes/file", "syscalls", "p50 ms", "p99 ms", "p99.9 ms" );
+    for ( size_t i = 0; i < tallyCount; ++i )
+    {
+        printTally( &tallies[i] );
+        free( tallies[i].latencies );
+    }
+
+    for ( size_t i = 0; i < entryCount; ++i )
+    {
+        free( entries[i].kind );
+        free( entries[i].path );
+    }
+    free( entries );
+    free( tallies );
+
+    stopLogging();
+
+    return 0;
+}
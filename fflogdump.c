@@ -0,0 +1,425 @@
+/*
+    Renders a binary log (see binlog.h) as text.
+
+    usage: fflogdump <binary log> [<binary log> ...]
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "logging.h"
+#include "binlog.h"
+
+const char *  gExecName;  /* base name of the executable, derived from argv[0] */
+
+extern const char *priorityToString[];
+
+typedef struct {
+    uint64_t        address;
+    const char     *text;       /* points into the mapped log, not terminated */
+    uint16_t        length;
+} tDumpString;
+
+typedef struct {
+    const char     *name;
+    uint16_t        length;
+} tDumpScope;
+
+typedef struct {
+    uint64_t        timestamp;
+    const char     *record;     /* the tBinLogMessage, in the mapped log */
+} tDumpMessage;
+
+static tDumpString *strings;
+static size_t       stringCount;
+static tDumpScope  *scopes;
+static size_t       scopeCount;
+static tDumpMessage *messages;
+static size_t       messageCount;
+
+static int compareStrings( const void *left, const void *right )
+{
+    const tDumpString *l = left;
+    const tDumpString *r = right;
+
+    return (l->address > r->address) - (l->address < r->address);
+}
+
+/* by time, and in the order they were written if they're at the same time */
+static int compareMessages( const void *left, const void *right )
+{
+    const tDumpMessage *l = left;
+    const tDumpMessage *r = right;
+
+    if ( l->timestamp != r->timestamp )
+    {
+        return (l->timestamp > r->timestamp) - (l->timestamp < r->timestamp);
+    }
+    return (l->record > r->record) - (l->record < r->record);
+}
+
+static const tDumpString *findString( uint64_t address )
+{
+    tDumpString key;
+
+    key.address = address;
+    return bsearch( &key, strings, stringCount, sizeof( tDumpString ), compareStrings );
+}
+
+/* copy a string out of the log so it can be handed to printf */
+static const char *terminate( const char *text, size_t length )
+{
+    static char buffer[UINT16_MAX + 1];
+
+    memcpy( buffer, text, length );
+    buffer[length] = '\0';
+    return buffer;
+}
+
+/* first pass: collect the string and scope definitions, and find the
+   messages. Each thread's records are written out a buffer at a time, so
+   they're in time order within a thread but not across threads */
+static int collectDefinitions( const char *log, size_t size )
+{
+    const char      *p, *end;
+    tBinLogString    string;
+    tBinLogScope     scope;
+    tBinLogMessage   msg;
+    size_t           capacity = 0, messageCapacity = 0;
+
+    p   = log + sizeof( tBinLogHeader );
+    end = log + size;
+
+    while ( p < end )
+    {
+        switch ( *p )
+        {
+        case kBinLogString:
+            if ( end - p < (ptrdiff_t)sizeof( string ) ) return -1;
+            memcpy( &string, p, sizeof( string ) );
+            p += sizeof( string );
+            if ( end - p < string.length ) return -1;
+
+            if ( stringCount == capacity )
+            {
+                capacity = (capacity == 0) ? 256 : capacity * 2;
+                strings  = realloc( strings, capacity * sizeof( tDumpString ) );
+                if ( strings == NULL ) return -1;
+            }
+            strings[stringCount].address = string.address;
+            strings[stringCount].text    = p;
+            strings[stringCount].length  = string.length;
+            ++stringCount;
+            p += string.length;
+            break;
+
+        case kBinLogScope:
+            if ( end - p < (ptrdiff_t)sizeof( scope ) ) return -1;
+            memcpy( &scope, p, sizeof( scope ) );
+            p += sizeof( scope );
+            if ( end - p < scope.length ) return -1;
+
+            if ( scope.scope < scopeCount )
+            {
+                scopes[scope.scope].name   = p;
+                scopes[scope.scope].length = scope.length;
+            }
+            p += scope.length;
+            break;
+
+        case kBinLogMessage:
+            if ( end - p < (ptrdiff_t)sizeof( msg ) ) return -1;
+            memcpy( &msg, p, sizeof( msg ) );
+            if ( end - p - (ptrdiff_t)sizeof( msg ) < msg.argBytes ) return -1;
+
+            if ( messageCount == messageCapacity )
+            {
+                messageCapacity = (messageCapacity == 0) ? 1024 : messageCapacity * 2;
+                messages = realloc( messages, messageCapacity * sizeof( tDumpMessage ) );
+                if ( messages == NULL ) return -1;
+            }
+            messages[messageCount].timestamp = msg.timestamp;
+            messages[messageCount].record    = p;
+            ++messageCount;
+            p += sizeof( msg ) + msg.argBytes;
+            break;
+
+        default:
+            return -1;
+        }
+    }
+
+    qsort( strings, stringCount, sizeof( tDumpString ), compareStrings );
+
+    return (p == end) ? 0 : -1;
+}
+
+/* print a single conversion, rewriting it to match the encoded argument */
+static int renderConversion( const tBinLogConversion *conv, const char **args, const char *argEnd )
+{
+    char            format[64];
+    char           *f;
+    const char     *c;
+    int64_t         star[2];
+    int             stars = 0;
+    int64_t         value;
+    double          real;
+    uint16_t        length;
+
+    if ( conv->arg == kBinArgNone )
+    {
+        fputs( (conv->conversion == '%') ? "%" : "?", stdout );
+        return 0;
+    }
+
+    for ( int i = 0; i < conv->starWidth + conv->starPrecision; ++i )
+    {
+        if ( argEnd - *args < (ptrdiff_t)sizeof( int64_t ) ) return -1;
+        memcpy( &star[stars++], *args, sizeof( int64_t ) );
+        *args += sizeof( int64_t );
+    }
+
+    /* rebuild the conversion, minus any stars and length modifiers */
+    stars = 0;
+    f = format;
+    for ( c = conv->start; c < conv->end - 1 && f < &format[sizeof( format ) - 32]; ++c )
+    {
+        if ( *c == '*' && c[-1] == '.' && star[stars] < 0 )
+            { --f; ++stars; }     /* a negative precision is as if there were none */
+        else if ( *c == '*' )
+            { f += sprintf( f, "%d", (int)star[stars++] ); }
+        else if ( strchr( "hlqjztL", *c ) == NULL )
+            { *f++ = *c; }
+    }
+
+    switch ( conv->arg )
+    {
+    case kBinArgInt:
+    case kBinArgUnsigned:
+    case kBinArgPointer:
+    case kBinArgErrno:
+        if ( argEnd - *args < (ptrdiff_t)sizeof( value ) ) return -1;
+        memcpy( &value, *args, sizeof( value ) );
+        *args += sizeof( value );
+
+        switch ( conv->conversion )
+        {
+        case 'c':
+            sprintf( f, "c" );
+            printf( format, (int)value );
+            break;
+
+        case 'p':
+            sprintf( f, "p" );
+            printf( format, (void *)(uintptr_t)value );
+            break;
+
+        case 'n':
+            break;
+
+        case 'm':
+            sprintf( f, "s" );
+            printf( format, strerror( (int)value ) );
+            break;
+
+        default:
+            sprintf( f, "ll%c", conv->conversion );
+            if ( conv->arg == kBinArgInt )
+                { printf( format, (long long)value ); }
+            else
+                { printf( format, (unsigned long long)value ); }
+            break;
+        }
+        break;
+
+    case kBinArgDouble:
+        if ( argEnd - *args < (ptrdiff_t)sizeof( real ) ) return -1;
+        memcpy( &real, *args, sizeof( real ) );
+        *args += sizeof( real );
+
+        sprintf( f, "%c", conv->conversion );
+        printf( format, real );
+        break;
+
+    case kBinArgString:
+        if ( argEnd - *args < (ptrdiff_t)sizeof( length ) ) return -1;
+        memcpy( &length, *args, sizeof( length ) );
+        *args += sizeof( length );
+        if ( argEnd - *args < length ) return -1;
+
+        sprintf( f, "s" );
+        printf( format, terminate( *args, length ) );
+        *args += length;
+        break;
+
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+static void renderMessage( const tBinLogMessage *msg, const char *args )
+{
+    const tDumpString  *format, *file;
+    tBinLogConversion   conv;
+    const char         *text, *p, *next, *argEnd;
+    char                stamp[32];
+    struct tm           tm;
+    time_t              seconds;
+
+    seconds = msg->timestamp / 1000000000;
+    localtime_r( &seconds, &tm );
+    strftime( stamp, sizeof( stamp ), "%Y-%m-%d %H:%M:%S", &tm );
+
+    printf( "%s.%06lu %s: ", stamp, (unsigned long)(msg->timestamp % 1000000000) / 1000,
+            (msg->priority <= kLogDebug) ? priorityToString[msg->priority] : "?" );
+    if ( msg->scope < scopeCount && scopes[msg->scope].name != NULL )
+    {
+        printf( "[%.*s] ", scopes[msg->scope].length, scopes[msg->scope].name );
+    }
+
+    format = findString( msg->format );
+    if ( format == NULL )
+    {
+        printf( "<unknown format %#llx>\n", (unsigned long long)msg->format );
+        return;
+    }
+
+    /* the format has to be terminated for _binLogNextConversion() */
+    text   = strdup( terminate( format->text, format->length ) );
+    argEnd = args + msg->argBytes;
+    if ( text == NULL )
+    {
+        return;
+    }
+
+    p = text;
+    while ( (next = _binLogNextConversion( p, &conv )) != NULL )
+    {
+        fwrite( p, 1, conv.start - p, stdout );
+        if ( renderConversion( &conv, &args, argEnd ) != 0 )
+        {
+            fputs( "<truncated>", stdout );
+            p = "";
+            break;
+        }
+        p = next;
+    }
+    fputs( p, stdout );
+    free( (void *)text );
+
+    if ( msg->line != 0 )
+    {
+        file = findString( msg->file );
+        if ( file != NULL )
+            { printf( " (%.*s:%u)", file->length, file->text, msg->line ); }
+        else
+            { printf( " (?:%u)", msg->line ); }
+    }
+    putchar( '\n' );
+}
+
+static int dumpLog( const char *path )
+{
+    int              fd;
+    struct stat      st;
+    const char      *log;
+    tBinLogHeader    header;
+    tBinLogMessage   msg;
+    int              result = 0;
+
+    fd = open( path, O_RDONLY );
+    if ( fd == -1 || fstat( fd, &st ) != 0 )
+    {
+        fprintf( stderr, "%s: unable to open \"%s\" (%s)\n", gExecName, path, strerror( errno ) );
+        return -1;
+    }
+    if ( (size_t)st.st_size < sizeof( header ) )
+    {
+        fprintf( stderr, "%s: \"%s\" is not a binary log\n", gExecName, path );
+        close( fd );
+        return -1;
+    }
+
+    log = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( log == MAP_FAILED )
+    {
+        fprintf( stderr, "%s: unable to map \"%s\" (%s)\n", gExecName, path, strerror( errno ) );
+        return -1;
+    }
+
+    memcpy( &header, log, sizeof( header ) );
+    if ( memcmp( header.magic, kBinLogMagic, sizeof( header.magic ) ) != 0 || header.version != kBinLogVersion )
+    {
+        fprintf( stderr, "%s: \"%s\" is not a binary log (or is from a different version)\n", gExecName, path );
+        munmap( (void *)log, st.st_size );
+        return -1;
+    }
+
+    stringCount  = 0;
+    messageCount = 0;
+    scopeCount   = header.scopeCount;
+    scopes      = calloc( scopeCount, sizeof( tDumpScope ) );
+
+    if ( scopes == NULL || collectDefinitions( log, st.st_size ) != 0 )
+    {
+        /* most likely the writer didn't get to flush; show what we can */
+        fprintf( stderr, "%s: \"%s\" is damaged or incomplete\n", gExecName, path );
+        result = -1;
+    }
+
+    /* second pass: render the messages, in time order */
+    if ( scopes != NULL && messages != NULL )
+    {
+        qsort( messages, messageCount, sizeof( tDumpMessage ), compareMessages );
+        for ( size_t i = 0; i < messageCount; ++i )
+        {
+            memcpy( &msg, messages[i].record, sizeof( msg ) );
+            renderMessage( &msg, messages[i].record + sizeof( msg ) );
+        }
+    }
+
+    free( scopes );
+    munmap( (void *)log, st.st_size );
+
+    return result;
+}
+
+int main( int argc, const char *argv[] )
+{
+    int result = 0;
+
+    gExecName = strrchr(argv[0], '/');
+    if (gExecName == NULL)
+        { gExecName = argv[0]; }
+    else
+        { ++gExecName; }
+
+    if ( argc < 2 )
+    {
+        fprintf( stderr, "usage: %s <binary log> [<binary log> ...]\n", gExecName );
+        return 1;
+    }
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( dumpLog( argv[i] ) != 0 )
+        {
+            result = 1;
+        }
+    }
+
+    return result;
+}
@@ -12,11 +12,21 @@
 #include <ctype.h>
 
 #include <fcntl.h>
+#include <pthread.h>
 
 #include "common.h"     /* common stuff */
 #include "config.h"     /* config file & command line configuration parsing */
 
 #include "logging.h"    /* my logging support */
+#include "tracing.h"    /* function call tracing */
+#include "probe.h"      /* the actual work */
+#include "stats.h"      /* per-stage timings & counters */
+#include "dedupe.h"     /* probe-once for hardlinks & copies */
+#include "shard.h"      /* splitting a scan between processes */
+#include "store.h"      /* columnar result store & queries */
+#include "pool.h"       /* worker threads */
+#include "pathstream.h" /* paths from a pipe */
+#include "oui.h"        /* the compact OUI database */
 
 
 /*
@@ -65,8 +75,15 @@ void restartChildren(int UNUSED(signal))
  * exits so no root zombies are created. The default handler for SIGINT sends
  * SIGINT to all children, but this is not true with SIGTERM.
  */
-void terminateChildren(int UNUSED(signal))
+void terminateChildren(int signal)
 {
+    /* there are no children (yet), so just go the way we would have without the trap */
+    struct sigaction dfl;
+
+    memset( &dfl, 0, sizeof( dfl ) );
+    dfl.sa_handler = SIG_DFL;
+    sigaction( signal, &dfl, NULL );
+    raise( signal );
 }
 
 /* suppress an (apparently) spurious warning */
@@ -84,6 +101,12 @@ static struct {
     { SIGCHLD, { &restartChildren, {}, SA_NOCLDSTOP } },
     { SIGINT,  { &terminateChildren } },
     { SIGTERM, { &terminateChildren } },
+    /* another process has left us new log settings (see sendLogControl) */
+    { SIGUSR1, { &logControlSignal, {}, SA_RESTART } },
+    /* write out the function profile so far (see startProfiling) */
+    { SIGUSR2, { &profileDumpSignal, {}, SA_RESTART } },
+    /* re-read the configuration, between files (see reloadConfiguration) */
+    { SIGHUP,  { &configReloadSignal, {}, SA_RESTART } },
     { 0 } /* end of list */
 };
 #pragma GCC diagnostic pop
@@ -116,6 +139,174 @@ int trapSignals(bool on)
 }
 
 
+/*
+ * the paths being scanned, shared with the workers. Item i is in slot
+ * i % capacity (see poolStartStream)
+ */
+typedef struct {
+    unsigned int    capacity;
+    const char    **paths;
+    int            *representative;     /* item number, see dedupePaths() */
+    tProbeResult   *results;
+    int            *errors;             /* probeFile()'s return value */
+} tScan;
+
+/* pool worker: probe one path, unless it's a duplicate, and judge it
+   against the device in the configuration current once it's probed */
+static int probeItem( void *context, unsigned int index, unsigned int worker )
+{
+    tScan                  *scan = context;
+    unsigned int            slot = index % scan->capacity;
+    tProbeResult           *result = &scan->results[slot];
+    const tConfigOptions   *config;
+    uint64_t                start;
+
+    if ( (unsigned int)scan->representative[slot] != index )
+    {
+        return 0;
+    }
+    scan->errors[slot] = probeFile( scan->paths[slot], result );
+    if ( scan->errors[slot] == 0 )
+    {
+        start  = statsNow();
+        config = configAcquire( worker );
+        result->verdict = deviceVerdict( &config->device, result );
+        configRelease( worker );
+        result->stageNs[kStageVerdict] += statsNow() - start;
+    }
+    return 1;
+}
+
+/*
+ * --files-from: a thread reads the paths and adds them to the pool in
+ * batches, as they arrive. Duplicates are found within a batch, so the
+ * consumer keeps a batch's worth of items behind it.
+ */
+#define kFeedBatch      4096
+#define kFeedCapacity   (4 * kFeedBatch)
+
+typedef struct {
+    tScan          *scan;
+    tPathStream    *input;
+    tShard          shard;
+    int             noDedupe;
+    int             failed;         /* reading the paths stopped with an error */
+} tFeed;
+
+static void *feedPaths( void *arg )
+{
+    static const char  *batch[kFeedBatch];
+    static int          representative[kFeedBatch];
+    tFeed              *feed = arg;
+    tScan              *scan = feed->scan;
+    const char         *path;
+    unsigned int        first = 0, slot;
+    unsigned long       total = 0;
+    int                 count, result = 1;
+
+    while ( result > 0 )
+    {
+        /* take what's there, but don't wait for a whole batch */
+        count = 0;
+        while ( count < kFeedBatch && (count == 0 || pathStreamBuffered( feed->input )) )
+        {
+            result = pathStreamNext( feed->input, &path );
+            if ( result <= 0 )
+            {
+                break;
+            }
+            ++total;
+            if ( inShard( &feed->shard, path ) )
+            {
+                batch[count++] = strdup( path );
+                if ( batch[count - 1] == NULL )
+                {
+                    logError( "out of memory" );
+                    exit( __LINE__ );
+                }
+            }
+        }
+        if ( count == 0 )
+        {
+            continue;
+        }
+
+        if ( feed->noDedupe )
+        {
+            for ( int i = 0; i < count; ++i )
+                { representative[i] = i; }
+        }
+        else
+        {
+            dedupePaths( batch, count, representative );
+        }
+
+        poolReserve( count );
+        for ( int i = 0; i < count; ++i )
+        {
+            slot = (first + i) % scan->capacity;
+            free( (char *)scan->paths[slot] );
+            scan->paths[slot]          = batch[i];
+            scan->representative[slot] = first + representative[i];
+        }
+        poolAdd( count );
+        first += count;
+    }
+    poolEnd();
+
+    /* pathStreamNext() has logged the error; the scan mustn't pass for a
+       complete one */
+    feed->failed = (result < 0);
+
+    if ( feed->shard.count > 1 )
+    {
+        logInfo( "shard %u/%u: %u of %lu paths", feed->shard.index, feed->shard.count, first, total );
+    }
+    else
+    {
+        logInfo( "%u paths read", first );
+    }
+
+    return NULL;
+}
+
+/* the pool settings in 'config'. Returns 0 on success */
+static int poolOptionsFrom( const tConfigOptions *config, tPoolOptions *options )
+{
+    options->jobs = 1;
+    if ( config->jobs != NULL && parsePoolJobs( config->jobs, &options->jobs ) != 0 )
+    {
+        return -1;
+    }
+    options->latencyCeiling = config->latencyCeiling;
+    options->loadCeiling    = config->loadCeiling;
+    return 0;
+}
+
+/* after a SIGHUP: pick up the new log level and pool settings. The paths,
+   the store, the stats and the log destination stay as they were. Called
+   between files, and while waiting for one (see poolOnIdle) */
+static void reloadScan( void )
+{
+    const tConfigOptions   *config;
+    tPoolOptions            options;
+
+    if ( !configReloadRequested() )
+    {
+        return;
+    }
+    config = reloadConfiguration();
+    if ( config == NULL || poolOptionsFrom( config, &options ) != 0 )
+    {
+        return;
+    }
+    for ( int i = 0; i < kMaxLogScope; ++i )
+    {
+        setLogLevel( i, config->debugLevel );
+    }
+    poolSetOptions( &options );
+}
+
 /*
  * Main entry point.
  * parse command line options and then process them.
@@ -124,6 +315,17 @@ int trapSignals(bool on)
 int main( int argc, const char *argv[] )
 {
     tConfigOptions *config;
+    tScan           scan;
+    int             pathCount;
+    tPoolOptions    poolOptions;
+    unsigned int    worker, slot, from;
+    tShard          shard = { 0, 1 };
+    tStoreWriter   *store = NULL;
+    tFeed           feed;
+    pthread_t       feeder;
+    int             err;
+    int             status = 0;
+    uint64_t        start;
 
     /* extract the executable name */
     gExecName = strrchr(argv[0], '/');
@@ -139,18 +341,234 @@ int main( int argc, const char *argv[] )
 
     config = parseConfiguration( argc, argv );
 
+    if ( config->controlPid != 0 )
+    {
+        /* we're just the messenger */
+        return ( sendLogControl( config->controlPid, config->argc, config->argv ) == 0 ) ? 0 : 1;
+    }
+    if ( config->readStats != NULL )
+    {
+        return ( statsPrint( stdout, config->readStats ) == 0 ) ? 0 : 1;
+    }
+    if ( config->argc > 0 && strcmp( config->argv[0], "query" ) == 0 )
+    {
+        if ( config->argc < 2 )
+        {
+            logError( "usage: %s query <store> [<field><op><value> ...]", gExecName );
+            return 1;
+        }
+        initProbe();
+        return ( storeQuery( stdout, config->argv[1], config->argc - 2, &config->argv[2] ) == 0 ) ? 0 : 1;
+    }
+    if ( config->argc > 0 && strcmp( config->argv[0], "oui-compact" ) == 0 )
+    {
+        /* the dense oui.db, converted to the compact format */
+        return ( ouiCompactDense( (config->argc > 1) ? config->argv[1] : kOUIDefaultPath ) == 0 ) ? 0 : 1;
+    }
+    if ( config->argc > 0 && strcmp( config->argv[0], "oui-import" ) == 0 )
+    {
+        if ( config->argc < 2 )
+        {
+            logError( "usage: %s oui-import <oui.txt> [<database>]", gExecName );
+            return 1;
+        }
+        return ( ouiImport( config->argv[1], (config->argc > 2) ? config->argv[2] : kOUIDefaultPath ) == 0 ) ? 0 : 1;
+    }
+    if ( config->merge )
+    {
+        return ( mergeShards( stdout, config->argc, config->argv ) == 0 ) ? 0 : 1;
+    }
+    if ( config->shard != NULL && parseShard( config->shard, &shard ) != 0 )
+    {
+        return 1;
+    }
+    if ( poolOptionsFrom( config, &poolOptions ) != 0 )
+    {
+        return 1;
+    }
+    if ( config->filesFrom != NULL && config->argc > 0 )
+    {
+        logError( "give the paths on the command line or with --files-from, not both" );
+        return 1;
+    }
+
+    enableLogControl();
+    trapSignals( true );
+
     // re-enable logging with user-supplied configuration
-    startLogging( config->debugLevel, config->logFile );
+    if ( config->binaryLog )
+    {
+        startLoggingTo( config->debugLevel, kLogToBinary, config->logFile );
+    }
+    else
+    {
+        startLogging( config->debugLevel, config->logFile );
+    }
+
+    if ( config->traceFile != NULL )
+    {
+        startTracing( config->traceFile );
+    }
+    else if ( config->profileFile != NULL )
+    {
+        startProfiling( config->profileFile );
+    }
 
     //logDebug( "%s started", gExecName );
 
     /* do something useful */
-    for ( int i = 0; i < config->argc; ++i )
+    initProbe();
+    /* one block of stats per worker there could ever be: a reload can
+       switch to --jobs auto, which may grow the pool that far */
+    if ( statsOpen( config->statsFile, kPoolMaxWorkers ) != 0 )
+    {
+        exit( __LINE__ );
+    }
+
+    feed.input  = NULL;
+    feed.failed = 0;
+    if ( config->filesFrom != NULL )
+    {
+        feed.input = pathStreamOpen( config->filesFrom, config->nullInput ? '\0' : '\n' );
+        if ( feed.input == NULL )
+        {
+            exit( __LINE__ );
+        }
+    }
+
+    scan.capacity       = (feed.input != NULL) ? kFeedCapacity : (unsigned int)config->argc + 1;
+    scan.paths          = calloc( scan.capacity, sizeof( char * ) );
+    scan.results        = calloc( scan.capacity, sizeof( tProbeResult ) );
+    scan.representative = calloc( scan.capacity, sizeof( int ) );
+    scan.errors         = calloc( scan.capacity, sizeof( int ) );
+    if ( scan.paths == NULL || scan.results == NULL || scan.representative == NULL || scan.errors == NULL )
+    {
+        logError( "out of memory" );
+        exit( __LINE__ );
+    }
+
+    if ( config->storeFile != NULL )
+    {
+        store = storeCreate( config->storeFile );
+    }
+
+    /* the workers probe, we write out the results in order as they come in.
+       Only this thread touches the stats and the store */
+    if ( feed.input != NULL )
+    {
+        feed.scan     = &scan;
+        feed.shard    = shard;
+        feed.noDedupe = config->noDedupe;
+        if ( poolStartStream( scan.capacity, probeItem, &scan, &poolOptions ) != 0 )
+        {
+            exit( __LINE__ );
+        }
+        err = pthread_create( &feeder, NULL, feedPaths, &feed );
+        if ( err != 0 )
+        {
+            logError( "unable to start reading the paths (%d: %s)", err, strerror( err ) );
+            exit( __LINE__ );
+        }
+    }
+    else
+    {
+        /* our share of the paths */
+        pathCount = 0;
+        for ( int i = 0; i < config->argc; ++i )
+        {
+            if ( inShard( &shard, config->argv[i] ) )
+                { scan.paths[pathCount++] = config->argv[i]; }
+        }
+        if ( shard.count > 1 )
+        {
+            logInfo( "shard %u/%u: %d of %d paths", shard.index, shard.count, pathCount, config->argc );
+        }
+
+        if ( config->noDedupe )
+        {
+            for ( int i = 0; i < pathCount; ++i )
+                { scan.representative[i] = i; }
+        }
+        else
+        {
+            dedupePaths( scan.paths, pathCount, scan.representative );
+        }
+
+        if ( poolStart( pathCount, probeItem, &scan, &poolOptions ) != 0 )
+        {
+            exit( __LINE__ );
+        }
+    }
+
+    /* so a SIGHUP isn't left pending while a --files-from stream is quiet,
+       or a file takes a long time */
+    poolOnIdle( reloadScan );
+
+    for ( unsigned int i = 0; poolMore( i ); ++i )
+    {
+        worker = poolWait( i );
+        slot   = i % scan.capacity;
+
+        reloadScan();
+
+        if ( (unsigned int)scan.representative[slot] != i )
+        {
+            /* same file, or a copy of one, we've already probed */
+            from = scan.representative[slot] % scan.capacity;
+            scan.results[slot] = scan.results[from];
+            printProbeResult( stdout, scan.paths[slot], &scan.results[slot] );
+            if ( store != NULL )
+                { storeAdd( store, scan.paths[slot], &scan.results[slot] ); }
+        }
+        else
+        {
+            start = statsNow();
+            printProbeResult( stdout, scan.paths[slot], &scan.results[slot] );
+            scan.results[slot].stageNs[kStageOutput] = statsNow() - start;
+
+            statsRecord( statsWorker( worker ), &scan.results[slot], scan.errors[slot] );
+            if ( store != NULL )
+                { storeAdd( store, scan.paths[slot], &scan.results[slot] ); }
+        }
+
+        /* a duplicate looks back at most a batch, for the earlier copy */
+        if ( i + 1 > kFeedBatch )
+        {
+            poolRelease( i + 1 - kFeedBatch );
+        }
+    }
+
+    if ( feed.input != NULL )
     {
-	fprintf(stdout, "%02d: %s\n", i, config->argv[i]);
+        pthread_join( feeder, NULL );
+        if ( feed.failed )
+        {
+            logError( "not every path could be read, the scan is incomplete" );
+            status = 1;
+        }
+        pathStreamClose( feed.input );
+        for ( unsigned int i = 0; i < scan.capacity; ++i )
+        {
+            free( (char *)scan.paths[i] );
+        }
     }
+    poolStop();
 
+    if ( store != NULL && storeClose( store ) != 0 )
+    {
+        exit( __LINE__ );
+    }
+
+    free( scan.errors );
+    free( scan.representative );
+    free( scan.results );
+    free( scan.paths );
+
+    statsLogSummary();
+    statsClose();
+
+    stopTracing();
     stopLogging();
 
-    return 0;
+    return status;
 }
@@ -0,0 +1,122 @@
+/*
+    Microbenchmark: the cost of a disabled log call in a hot loop.
+
+    'runtime check' is what every call site used to compile to - a load of
+    the scope's level and a compare. 'below floor' is the same call site
+    when the build-time floor for the scope is above the call's priority,
+    so it is compiled out altogether.
+
+    usage: logbench [iterations]
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+
+#include "logging.h"
+
+/* normally set per scope by the Makefile; pinned here so the 'after' case
+   is compiled out regardless of how the benchmark was built */
+#undef  kLogFloor_logbench
+#define kLogFloor_logbench  kLogInfo
+
+/* keeps the optimizer from deleting the loops */
+volatile uint64_t gSink;
+
+static double elapsed( const struct timespec *start )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static double loopEmpty( uint64_t iterations )
+{
+    struct timespec start;
+    uint64_t        sum = 0;
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    for ( uint64_t i = 0; i < iterations; ++i )
+    {
+        sum += i ^ gSink;
+    }
+    gSink = sum;
+
+    return elapsed( &start );
+}
+
+static double loopRuntimeCheck( uint64_t iterations )
+{
+    struct timespec start;
+    uint64_t        sum = 0;
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    for ( uint64_t i = 0; i < iterations; ++i )
+    {
+        sum += i ^ gSink;
+        if ( logCheckRuntime( kLogDebug, LOG_SCOPE ) )
+        {
+            _logWithLocation( __FILE__, __LINE__, logScope( LOG_SCOPE ), kLogDebug, "iteration %llu", (unsigned long long)i );
+        }
+    }
+    gSink = sum;
+
+    return elapsed( &start );
+}
+
+static double loopBelowFloor( uint64_t iterations )
+{
+    struct timespec start;
+    uint64_t        sum = 0;
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    for ( uint64_t i = 0; i < iterations; ++i )
+    {
+        sum += i ^ gSink;
+        logDebug( "iteration %llu", (unsigned long long)i );
+    }
+    gSink = sum;
+
+    return elapsed( &start );
+}
+
+int main( int argc, const char *argv[] )
+{
+    uint64_t    iterations = 200000000;
+    double      empty, runtime, belowFloor;
+
+    if ( argc > 1 )
+    {
+        iterations = strtoull( argv[1], NULL, 0 );
+    }
+
+    initLogging( "logbench" );
+    startLoggingTo( kLogNotice, kLogToUndefined, NULL );
+
+    /* debug is disabled at runtime, so neither loop ever logs anything */
+    for ( int i = 0; i < kMaxLogScope; ++i )
+    {
+        setLogLevel( i, kLogNotice );
+    }
+
+    /* best of several runs, interleaved so frequency scaling hits them all alike */
+    empty = runtime = belowFloor = 1e9;
+    for ( int run = 0; run < 5; ++run )
+    {
+        empty      = fmin( empty,      loopEmpty( iterations ) );
+        runtime    = fmin( runtime,    loopRuntimeCheck( iterations ) );
+        belowFloor = fmin( belowFloor, loopBelowFloor( iterations ) );
+    }
+
+    printf( "disabled logDebug() in a loop of %llu iterations:\n", (unsigned long long)iterations );
+    printf( "  %-24s %8.3f ns/iteration\n", "empty loop", empty * 1e9 / iterations );
+    printf( "  %-24s %8.3f ns/iteration (%+.3f)\n", "runtime check (before)", runtime * 1e9 / iterations, (runtime - empty) * 1e9 / iterations );
+    printf( "  %-24s %8.3f ns/iteration (%+.3f)\n", "below floor (after)",    belowFloor * 1e9 / iterations, (belowFloor - empty) * 1e9 / iterations );
+
+    stopLogging();
+
+    return 0;
+}
@@ -8,10 +8,18 @@
 #include <syslog.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include <dlfcn.h>
 
 #include "logging.h"
+#include "binlog.h"
 
 #ifdef UNUSED
 #elif defined(__GNUC__)
@@ -35,11 +43,12 @@ unsigned int    gLogLevel = 0;
 const char    * gLogName = "";
 FILE          * gLogFile;
 
+int             gBinLogFD = -1;
+unsigned int    gBinLogGeneration = 0;  /* bumped each time a binary log is opened */
+
 void          * gDLhandle = NULL;
 int             gFunctionTraceEnabled = 0;
-int             gCallDepth = 1;
 
-const char *leader = "..........................................................................................";
 const char *priorityToString[] =
 {
     [kLogEmergency] = "Emergency",
@@ -83,10 +92,23 @@ const char *priorityToTerm[] =
 void initLogging( const char *name )
                             __attribute__((no_instrument_function));
 
-void _log(unsigned int priority, const char *format, ...)
+void _log(unsigned int scope, unsigned int priority, const char *format, ...)
+                            __attribute__((no_instrument_function));
+
+void _logWithLocation(const char *inFile, unsigned int atLine, unsigned int scope, unsigned int priority, const char *format, ...)
+                            __attribute__((no_instrument_function));
+
+void _logBinary(const char *inFile, unsigned int atLine, unsigned int scope, unsigned int priority, const char *format, va_list vaptr)
                             __attribute__((no_instrument_function));
 
-void _logWithLocation(const char *inFile, unsigned int atLine, unsigned int priority, const char *format, ...)
+void _logBinaryf(const char *inFile, unsigned int atLine, unsigned int scope, unsigned int priority, const char *format, ...)
+                            __attribute__((no_instrument_function));
+
+int _binLogOpen( const char *logFile )
+                            __attribute__((no_instrument_function));
+
+void logFlush( void )       __attribute__((no_instrument_function));
+static void _binLogFlushAll( void )
                             __attribute__((no_instrument_function));
 
 void _logToTheVoid( unsigned int priority, const char *msg )
@@ -97,27 +119,268 @@ void _logToFile(    unsigned int priority, const char *msg )
                             __attribute__((no_instrument_function));
 void _logToStderr(  unsigned int priority, const char *msg )
                             __attribute__((no_instrument_function));
+void _logToBinary(  unsigned int priority, const char *msg )
+                            __attribute__((no_instrument_function));
 
 void _logString(unsigned int priority, const char *format)
                             __attribute__((no_instrument_function));
 
-void _profileHelper(void *left, const char *middle, void *right)
-                            __attribute__((no_instrument_function));
+/********** DO NOT INSTRUMENT THE INSTRUMENTATION! **********/
 
-const char *addrToString(void *addr, char *scratch)
-                            __attribute__((no_instrument_function));
+void setLogLevel( int logScope, tPriority level )
+{
+    gLog[logScope].level = level;
+}
 
-void __cyg_profile_func_enter(void *this_fn, void *call_site)
-                            __attribute__((no_instrument_function));
+/*
+    Live control of the log levels and function tracing.
 
-void __cyg_profile_func_exit(void *this_fn, void *call_site)
-                            __attribute__((no_instrument_function));
+    'fftest --logctl <pid> config=debug trace=on' writes the settings to
+    logControlPath(<pid>) and sends that process SIGUSR1. Its handler reads
+    the file back and applies the settings with plain stores to gLog[] and
+    gFunctionTraceEnabled, so the logging fast path doesn't need any locks;
+    it just sees the new level on its next check.
 
-/********** DO NOT INSTRUMENT THE INSTRUMENTATION! **********/
+    Everything on the receiving side has to be async-signal-safe, so no
+    stdio, no malloc and no logging.
+ */
 
-void setLogLevel( int logScope, tPriority level )
+#define kLogControlMax  4096
+
+static char _lower( char c )
 {
-    gLog[logScope].level = level;
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+/* case-insensitive match of an unterminated token against name */
+static int _tokenIs( const char *token, size_t length, const char *name )
+{
+    size_t i;
+
+    for ( i = 0; i < length; ++i )
+    {
+        if ( name[i] == '\0' || _lower( token[i] ) != _lower( name[i] ) )
+        {
+            return 0;
+        }
+    }
+    return name[i] == '\0';
+}
+
+/* a level may be a number or a name, e.g. '7' or 'debug'. Returns -1 if it's neither */
+static int _parseLevel( const char *token, size_t length )
+{
+    if ( length == 1 && token[0] >= '0' && token[0] <= '7' )
+    {
+        return token[0] - '0';
+    }
+    for ( int level = kLogEmergency; level <= kLogDebug; ++level )
+    {
+        if ( _tokenIs( token, length, priorityToString[level] ) )
+        {
+            return level;
+        }
+    }
+    return -1;
+}
+
+/* apply a single 'name=value' setting, or with apply zero just check it.
+   Returns 0 if it was understood */
+static int _applySetting( const char *name, size_t nameLen, const char *value, size_t valueLen, int apply )
+{
+    int level;
+
+    if ( _tokenIs( name, nameLen, "trace" ) )
+    {
+        if ( _tokenIs( value, valueLen, "on" ) || _tokenIs( value, valueLen, "1" ) )
+            { if ( apply ) logFunctionTraceOn(); return 0; }
+        if ( _tokenIs( value, valueLen, "off" ) || _tokenIs( value, valueLen, "0" ) )
+            { if ( apply ) logFunctionTraceOff(); return 0; }
+        return -1;
+    }
+
+    level = _parseLevel( value, valueLen );
+    if ( level < 0 )
+    {
+        return -1;
+    }
+
+    if ( _tokenIs( name, nameLen, "all" ) )
+    {
+        for ( int i = 0; i < kMaxLogScope && apply; ++i )
+        {
+            setLogLevel( i, level );
+        }
+        return 0;
+    }
+
+    for ( int i = 0; i < kMaxLogScope; ++i )
+    {
+        if ( _tokenIs( name, nameLen, gLog[i].name ) )
+        {
+            if ( apply ) setLogLevel( i, level );
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int _logControl( const char *settings, size_t length, int apply )
+{
+    const char *p, *end, *token, *equals;
+    int         errors = 0;
+
+    p   = settings;
+    end = settings + length;
+    while ( p < end )
+    {
+        /* settings are separated by whitespace or commas */
+        while ( p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == ',') ) { ++p; }
+
+        token  = p;
+        equals = NULL;
+        while ( p < end && !(*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == ',') )
+        {
+            if ( *p == '=' && equals == NULL )
+            {
+                equals = p;
+            }
+            ++p;
+        }
+
+        if ( p > token )
+        {
+            if ( equals == NULL || _applySetting( token, equals - token, equals + 1, p - (equals + 1), apply ) != 0 )
+            {
+                ++errors;
+            }
+        }
+    }
+
+    return (errors == 0) ? 0 : -1;
+}
+
+int logControl( const char *settings, size_t length )
+{
+    return _logControl( settings, length, 1 );
+}
+
+/* builds the path of the control file for process pid */
+void logControlPath( pid_t pid, char *path, size_t size )
+{
+    snprintf( path, size, "/tmp/%s.%d.logctl", gLogName, (int)pid );
+}
+
+/* SIGUSR1 handler: apply whatever has been left in our control file */
+void logControlSignal( int UNUSED(signal) )
+{
+    static char     path[256];
+    char            settings[kLogControlMax];
+    struct stat     st;
+    ssize_t         length;
+    int             fd;
+    int             savedErrno = errno;
+
+    /* snprintf isn't async-signal-safe, so the path is worked out once, up front */
+    if ( path[0] != '\0' )
+    {
+        fd = open( path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC );
+        if ( fd != -1 )
+        {
+            /* only take orders from ourselves */
+            if ( fstat( fd, &st ) == 0 && st.st_uid == geteuid() )
+            {
+                length = read( fd, settings, sizeof( settings ) );
+                if ( length > 0 )
+                {
+                    logControl( settings, length );
+                }
+            }
+            close( fd );
+            unlink( path );
+        }
+    }
+    else
+    {
+        logControlPath( getpid(), path, sizeof( path ) );
+    }
+
+    errno = savedErrno;
+}
+
+void enableLogControl( void )
+{
+    /* calling with path unset just fills it in */
+    logControlSignal( 0 );
+}
+
+int sendLogControl( pid_t pid, int argc, const char *argv[] )
+{
+    char    path[256], temp[272];
+    FILE   *file;
+    int     fd, result = 0;
+
+    /* the target ignores what it doesn't understand, so catch typos here */
+    for ( int i = 0; i < argc; ++i )
+    {
+        if ( _logControl( argv[i], strlen( argv[i] ), 0 ) != 0 )
+        {
+            logError( "\"%s\" isn't a log setting - expected <scope>=<level>, all=<level> or trace=on|off", argv[i] );
+            result = -1;
+        }
+    }
+    if ( result != 0 )
+    {
+        return -1;
+    }
+
+    logControlPath( pid, path, sizeof( path ) );
+
+    /* /tmp is shared, so the temporary file gets a name nobody can guess
+       (and plant a symlink at) beforehand. mkstemp() creates it 0600 */
+    snprintf( temp, sizeof( temp ), "%s.XXXXXX", path );
+    fd = mkstemp( temp );
+    if ( fd == -1 )
+    {
+        logError( "unable to create \"%s\" (%d: %s)", temp, errno, strerror( errno ) );
+        return -1;
+    }
+    file = fdopen( fd, "w" );
+    if ( file == NULL )
+    {
+        logError( "unable to open \"%s\" (%d: %s)", temp, errno, strerror( errno ) );
+        close( fd );
+        unlink( temp );
+        return -1;
+    }
+    for ( int i = 0; i < argc; ++i )
+    {
+        fprintf( file, "%s\n", argv[i] );
+    }
+    result = ferror( file );
+    if ( fclose( file ) != 0 || result != 0 )
+    {
+        logError( "unable to write \"%s\"", temp );
+        unlink( temp );
+        return -1;
+    }
+
+    /* rename is atomic, so the handler never sees a partial file */
+    if ( rename( temp, path ) != 0 )
+    {
+        logError( "unable to rename \"%s\" to \"%s\" (%d: %s)", temp, path, errno, strerror( errno ) );
+        unlink( temp );
+        return -1;
+    }
+
+    if ( kill( pid, SIGUSR1 ) != 0 )
+    {
+        logError( "unable to signal process %d (%d: %s)", (int)pid, errno, strerror( errno ) );
+        unlink( path );
+        return -1;
+    }
+
+    return 0;
 }
 
 void initLogging( const char *name )
@@ -148,12 +411,18 @@ void initLogging( const char *name )
 
 void startLogging( unsigned int debugLevel, const char * logFile )
 {
-    gLogLevel = debugLevel;
-    eLogDestination logDest;
+    startLoggingTo( debugLevel, (logFile != NULL) ? kLogToFile : kLogToStderr, logFile );
+}
 
-    logDest = (logFile != NULL) ? kLogToFile : kLogToStderr;
+void startLoggingTo( unsigned int debugLevel, eLogDestination logDest, const char * logFile )
+{
+    gLogLevel = debugLevel;
+    for ( int i = 0; i < kMaxLogScope; ++i )
+    {
+        setLogLevel( i, gLogLevel );
+    }
 
-    if (logDest != gLogDestination)
+    if (logDest != gLogDestination || logDest == kLogToBinary)
     {
         stopLogging();
 
@@ -189,6 +458,20 @@ void startLogging( unsigned int debugLevel, const char * logFile )
             gLogString = &_logToStderr;
             break;
 
+        case kLogToBinary:
+            gLogString = &_logToStderr;
+
+            if ( _binLogOpen( logFile ) == 0 )
+            {
+                gLogString = &_logToBinary;
+            }
+            else
+            {
+                logDest = kLogToStderr;
+                logError("Unable to log to \"%s\" (%s [%d]), redirecting to stderr", logFile, strerror(errno), errno);
+            }
+            break;
+
         default:
             gLogString = &_logToTheVoid;
             break;
@@ -210,6 +493,12 @@ void stopLogging( void )
         gLogFile = stderr;
         break;
 
+    case kLogToBinary:
+        _binLogFlushAll();
+        close( gBinLogFD );
+        gBinLogFD = -1;
+        break;
+
         // don't do anything for the other cases
     default:
         break;
@@ -232,21 +521,33 @@ void _logToStderr(unsigned int priority, const char *msg)
     fprintf(stderr, "%s:" TEXT_BKGND_DEFAULT " %s\n", priorityToTerm[priority], msg);
 }
 
-void _log(unsigned int priority, const char *format, ...)
+void _logToBinary(unsigned int priority, const char *msg)
+{
+    _logBinaryf( NULL, 0, logScope( LOG_SCOPE ), priority, "%s", msg );
+}
+
+void _log(unsigned int scope, unsigned int priority, const char *format, ...)
 {
     va_list vaptr;
     char    msg[512];
 
     va_start(vaptr, format);
 
-    vsnprintf( msg, sizeof(msg), format, vaptr );
+    if ( gLogDestination == kLogToBinary )
+    {
+        _logBinary( NULL, 0, scope, priority, format, vaptr );
+    }
+    else
+    {
+        vsnprintf( msg, sizeof(msg), format, vaptr );
 
-    gLogString(priority, msg);
+        gLogString(priority, msg);
+    }
 
     va_end(vaptr);
 }
 
-void _logWithLocation(const char *inFile, unsigned int atLine, unsigned int priority, const char *format, ...)
+void _logWithLocation(const char *inFile, unsigned int atLine, unsigned int scope, unsigned int priority, const char *format, ...)
 {
     va_list vaptr;
     char    msg[256];
@@ -254,6 +555,13 @@ void _logWithLocation(const char *inFile, unsigned int atLine, unsigned int prio
 
     va_start(vaptr, format);
 
+    if ( gLogDestination == kLogToBinary )
+    {
+        _logBinary( inFile, atLine, scope, priority, format, vaptr );
+        va_end(vaptr);
+        return;
+    }
+
     prefixLen = vsnprintf( msg, sizeof(msg), format, vaptr );
 
     remaining = sizeof(msg) - prefixLen - 1;
@@ -268,66 +576,501 @@ void _logWithLocation(const char *inFile, unsigned int atLine, unsigned int prio
     va_end(vaptr);
 }
 
-const char *addrToString(void *addr, char *scratch)
+/*
+    Binary logging.
+
+    Rather than formatting the message, _logBinary() copies the raw arguments
+    into a per-thread buffer along with the address of the format string, and
+    leaves the formatting to fflogdump. The text of each format string (and
+    __FILE__) is only written the first time a thread uses it. The buffer is
+    written out when it fills, on logFlush(), and when its thread exits (it's
+    freed then too). stopLogging() writes out every thread's buffer, so the
+    other threads should have stopped logging by then.
+
+    Each buffer is written out whole, so records from different threads
+    don't interleave, but they aren't in time order either; fflogdump sorts
+    them by timestamp.
+
+    Strings passed as arguments are copied, up to kBinLogMaxString bytes or
+    the conversion's precision, whichever is less.
+ */
+
+#define kBinLogBufferSize   (64 * 1024)
+#define kBinLogMaxRecord    (20 * 1024)     /* largest message record, must be well under kBinLogBufferSize */
+#define kBinLogMaxString    (16 * 1024)     /* longest string argument that will be recorded */
+#define kBinLogSeenSize     1024            /* must be a power of two */
+
+typedef struct tBinLogBuffer {
+    struct tBinLogBuffer *next;             /* in gBinLogBuffers */
+    unsigned int    generation;             /* gBinLogGeneration when 'seen' was last cleared */
+    size_t          used;
+    uintptr_t       seen[kBinLogSeenSize];  /* strings this thread has already defined */
+    char            buffer[kBinLogBufferSize];
+} tBinLogBuffer;
+
+static __thread tBinLogBuffer *tlBinLog = NULL;
+
+/* every thread's buffer, so stopLogging() can flush them all */
+static tBinLogBuffer   *gBinLogBuffers = NULL;
+static pthread_mutex_t  gBinLogLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t    gBinLogKey;
+static pthread_once_t   gBinLogOnce = PTHREAD_ONCE_INIT;
+
+static void _binLogWrite( tBinLogBuffer *binLog )
+                            __attribute__((no_instrument_function));
+static void _binLogThreadExit( void *arg )
+                            __attribute__((no_instrument_function));
+static void _binLogCreateKey( void )
+                            __attribute__((no_instrument_function));
+static tBinLogBuffer *_binLogBuffer( void )
+                            __attribute__((no_instrument_function));
+static void _binLogReserve( tBinLogBuffer *binLog, size_t length )
+                            __attribute__((no_instrument_function));
+static void _binLogDefine( tBinLogBuffer *binLog, const char *string )
+                            __attribute__((no_instrument_function));
+
+/* write out the buffer, and empty it */
+static void _binLogWrite( tBinLogBuffer *binLog )
 {
-    const char   *str;
-    Dl_info info;
+    size_t   written = 0;
+    ssize_t  result;
 
-    str = NULL;
-    if (gDLhandle != NULL )
+    while ( gBinLogFD != -1 && written < binLog->used )
     {
-        dladdr(addr, &info);
-        str = info.dli_sname;
+        result = write( gBinLogFD, &binLog->buffer[written], binLog->used - written );
+        if ( result < 0 )
+        {
+            if ( errno == EINTR ) continue;
+            break;
+        }
+        written += result;
     }
-    if (str == NULL)
+    binLog->used = 0;
+}
+
+/* the thread that owned the buffer has exited: flush it, and free it */
+static void _binLogThreadExit( void *arg )
+{
+    tBinLogBuffer  *binLog = arg;
+    tBinLogBuffer **link;
+
+    pthread_mutex_lock( &gBinLogLock );
+    _binLogWrite( binLog );
+    for ( link = &gBinLogBuffers; *link != NULL; link = &(*link)->next )
     {
-        sprintf( scratch, "0x%08lx", (unsigned long)addr);
-        str = scratch;
+        if ( *link == binLog )
+        {
+            *link = binLog->next;
+            break;
+        }
     }
-    return str;
+    pthread_mutex_unlock( &gBinLogLock );
+
+    tlBinLog = NULL;
+    free( binLog );
 }
 
-/*
-    gcc inserts calls to these functions at the beginning and end of every
-    compiled function when the -finstrument-functions option is used.
+static void _binLogCreateKey( void )
+{
+    pthread_key_create( &gBinLogKey, _binLogThreadExit );
+}
+
+static tBinLogBuffer *_binLogBuffer( void )
+{
+    tBinLogBuffer *binLog = tlBinLog;
+
+    if ( binLog == NULL )
+    {
+        binLog = calloc( 1, sizeof( tBinLogBuffer ) );
+        if ( binLog == NULL )
+        {
+            return NULL;
+        }
+        tlBinLog = binLog;
 
-    If just left on, this generates so much logging that it's rarely useful.
-    Please use logFunctionTraceOn and logFunctionTraceOff around the
-    code/situation you care about.
-*/
+        /* the key's destructor runs when this thread exits */
+        pthread_once( &gBinLogOnce, _binLogCreateKey );
+        pthread_setspecific( gBinLogKey, binLog );
 
-void _profileHelper(void *left, const char *middle, void *right)
+        pthread_mutex_lock( &gBinLogLock );
+        binLog->next   = gBinLogBuffers;
+        gBinLogBuffers = binLog;
+        pthread_mutex_unlock( &gBinLogLock );
+    }
+    if ( binLog != NULL && binLog->generation != gBinLogGeneration )
+    {
+        /* a new log file doesn't have any of our strings in it yet */
+        memset( binLog->seen, 0, sizeof( binLog->seen ) );
+        binLog->generation = gBinLogGeneration;
+    }
+    return binLog;
+}
+
+void logFlush( void )
 {
-    // some scratch space, in case addrToString needs it. avoids needless malloc churn
-    char leftScratch[16];
-    char rightScratch[16];
-    char msg[256];
+    if ( tlBinLog != NULL )
+    {
+        _binLogWrite( tlBinLog );
+    }
+}
 
-    if (gFunctionTraceEnabled && gLogDestination != kLogToUndefined)
+/* write out every thread's buffer */
+static void _binLogFlushAll( void )
+{
+    pthread_mutex_lock( &gBinLogLock );
+    for ( tBinLogBuffer *binLog = gBinLogBuffers; binLog != NULL; binLog = binLog->next )
     {
-        snprintf(msg, sizeof(msg), "%.*s %s() %s %s()", gCallDepth, leader, addrToString(left, leftScratch), middle, addrToString(right, rightScratch));
-        gLogString(kLogDebug, msg);
+        _binLogWrite( binLog );
     }
+    pthread_mutex_unlock( &gBinLogLock );
 }
 
-/* just landed in a function */
-void __cyg_profile_func_enter(void *this_fn, void *call_site)
+/* make sure there's at least length bytes free in the buffer */
+static void _binLogReserve( tBinLogBuffer *binLog, size_t length )
 {
-    if (gFunctionTraceEnabled)
+    if ( binLog->used + length > kBinLogBufferSize )
+    {
+        logFlush();
+    }
+}
+
+static void _binLogDefine( tBinLogBuffer *binLog, const char *string )
+{
+    tBinLogString   record;
+    uintptr_t       key  = (uintptr_t)string;
+    /* direct-mapped, so a collision just means the string is defined again */
+    unsigned int    slot = (key >> 3) & (kBinLogSeenSize - 1);
+
+    if ( binLog->seen[slot] != key )
+    {
+        binLog->seen[slot] = key;
+
+        record.type    = kBinLogString;
+        record.address = key;
+        record.length  = strnlen( string, kBinLogMaxString );
+
+        _binLogReserve( binLog, sizeof( record ) + record.length );
+        memcpy( &binLog->buffer[binLog->used], &record, sizeof( record ) );
+        binLog->used += sizeof( record );
+        memcpy( &binLog->buffer[binLog->used], string, record.length );
+        binLog->used += record.length;
+    }
+}
+
+/* truncates (or creates) logFile, and writes the header and scope names */
+int _binLogOpen( const char *logFile )
+{
+    tBinLogBuffer  *binLog;
+    tBinLogHeader   header;
+    tBinLogScope    record;
+
+    if ( logFile == NULL )
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* appending, as each thread writes its buffer out independently */
+    gBinLogFD = open( logFile, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644 );
+    if ( gBinLogFD == -1 )
+    {
+        return -1;
+    }
+    ++gBinLogGeneration;
+
+    binLog = _binLogBuffer();
+    if ( binLog == NULL )
+    {
+        close( gBinLogFD );
+        gBinLogFD = -1;
+        errno = ENOMEM;
+        return -1;
+    }
+    binLog->used = 0;
+
+    memcpy( header.magic, kBinLogMagic, sizeof( header.magic ) );
+    header.version    = kBinLogVersion;
+    header.scopeCount = kMaxLogScope;
+    memcpy( &binLog->buffer[binLog->used], &header, sizeof( header ) );
+    binLog->used += sizeof( header );
+
+    for ( int i = 0; i < kMaxLogScope; ++i )
+    {
+        record.type   = kBinLogScope;
+        record.scope  = i;
+        record.length = strlen( gLog[i].name );
+        _binLogReserve( binLog, sizeof( record ) + record.length );
+        memcpy( &binLog->buffer[binLog->used], &record, sizeof( record ) );
+        binLog->used += sizeof( record );
+        memcpy( &binLog->buffer[binLog->used], gLog[i].name, record.length );
+        binLog->used += record.length;
+    }
+    logFlush();
+
+    return 0;
+}
+
+const char *_binLogNextConversion( const char *format, tBinLogConversion *conv )
+{
+    const char *p;
+
+    p = strchr( format, '%' );
+    if ( p == NULL )
+    {
+        return NULL;
+    }
+
+    conv->start         = p++;
+    conv->arg           = kBinArgNone;
+    conv->length        = kBinLenInt;
+    conv->starWidth     = 0;
+    conv->starPrecision = 0;
+    conv->precision     = -1;
+
+    /* flags */
+    while ( *p != '\0' && strchr( "-+ #0'", *p ) != NULL ) { ++p; }
+
+    /* field width */
+    if ( *p == '*' ) { conv->starWidth = 1; ++p; }
+    else while ( isdigit( (unsigned char)*p ) ) { ++p; }
+
+    /* precision */
+    if ( *p == '.' )
+    {
+        ++p;
+        conv->precision = 0;
+        if ( *p == '*' ) { conv->starPrecision = 1; ++p; }
+        else while ( isdigit( (unsigned char)*p ) ) { conv->precision = conv->precision * 10 + (*p - '0'); ++p; }
+    }
+
+    /* length modifier */
+    switch ( *p )
     {
-        _profileHelper(call_site, "called", this_fn);
+    case 'h':
+        ++p;
+        if ( *p == 'h' ) { conv->length = kBinLenChar; ++p; }
+        else             { conv->length = kBinLenShort; }
+        break;
+
+    case 'l':
+        ++p;
+        if ( *p == 'l' ) { conv->length = kBinLenLongLong; ++p; }
+        else             { conv->length = kBinLenLong; }
+        break;
+
+    case 'q': conv->length = kBinLenLongLong;   ++p; break;
+    case 'j': conv->length = kBinLenIntMax;     ++p; break;
+    case 'z': conv->length = kBinLenSize;       ++p; break;
+    case 't': conv->length = kBinLenPtrDiff;    ++p; break;
+    case 'L': conv->length = kBinLenLongDouble; ++p; break;
+
+    default:
+        break;
     }
-    ++gCallDepth;
+
+    conv->conversion = *p;
+    switch ( *p )
+    {
+    case '\0': /* a stray '%' at the end of the format */
+        return NULL;
+
+    case 'd': case 'i':
+        conv->arg = kBinArgInt;
+        break;
+
+    case 'u': case 'o': case 'x': case 'X':
+        conv->arg = kBinArgUnsigned;
+        break;
+
+    case 'c':
+        conv->arg    = kBinArgInt;
+        conv->length = kBinLenInt;
+        break;
+
+    case 'e': case 'E': case 'f': case 'F':
+    case 'g': case 'G': case 'a': case 'A':
+        conv->arg = kBinArgDouble;
+        break;
+
+    case 's':
+        conv->arg = kBinArgString;
+        break;
+
+    case 'p': case 'n':
+        conv->arg = kBinArgPointer;
+        break;
+
+    case 'm':
+        conv->arg = kBinArgErrno;
+        break;
+
+    default: /* '%', or something we don't understand */
+        break;
+    }
+    conv->end = p + 1;
+
+    return conv->end;
 }
 
-/* about to leave a function */
-void __cyg_profile_func_exit(void *this_fn, void *call_site)
+void _logBinary(const char *inFile, unsigned int atLine, unsigned int scope, unsigned int priority, const char *format, va_list vaptr)
 {
-    if (--gCallDepth < 1)
-        gCallDepth = 1;
+    tBinLogBuffer      *binLog;
+    tBinLogMessage      msg;
+    tBinLogConversion   conv;
+    struct timespec     now;
+    const char         *next, *string;
+    char               *start, *p, *limit;
+    int64_t             value;
+    double              real;
+    uint16_t            length;
+    size_t              maxLength;
+    int                 savedErrno = errno;
+
+    binLog = _binLogBuffer();
+    if ( binLog == NULL )
+    {
+        return;
+    }
+
+    clock_gettime( CLOCK_REALTIME, &now );
 
-    if (gFunctionTraceEnabled)
+    _binLogDefine( binLog, format );
+    if ( inFile != NULL )
     {
-        _profileHelper(this_fn, "returned to", call_site);
+        _binLogDefine( binLog, inFile );
     }
+
+    _binLogReserve( binLog, kBinLogMaxRecord );
+    start = &binLog->buffer[binLog->used];
+    p     = start + sizeof( msg );
+    limit = start + kBinLogMaxRecord;
+
+    next = format;
+    while ( (next = _binLogNextConversion( next, &conv )) != NULL )
+    {
+        if ( conv.starWidth )
+        {
+            value = va_arg( vaptr, int );
+            memcpy( p, &value, sizeof( value ) );
+            p += sizeof( value );
+        }
+        if ( conv.starPrecision )
+        {
+            value = va_arg( vaptr, int );
+            memcpy( p, &value, sizeof( value ) );
+            p += sizeof( value );
+            /* a negative precision is taken as if it were omitted */
+            conv.precision = (value < 0) ? -1 : value;
+        }
+
+        switch ( conv.arg )
+        {
+        case kBinArgInt:
+            switch ( conv.length )
+            {
+            case kBinLenChar:     value = (signed char)va_arg( vaptr, int ); break;
+            case kBinLenShort:    value = (short)va_arg( vaptr, int );       break;
+            case kBinLenLong:     value = va_arg( vaptr, long );             break;
+            case kBinLenLongLong: value = va_arg( vaptr, long long );        break;
+            case kBinLenIntMax:   value = va_arg( vaptr, intmax_t );         break;
+            case kBinLenSize:     value = va_arg( vaptr, ssize_t );          break;
+            case kBinLenPtrDiff:  value = va_arg( vaptr, ptrdiff_t );        break;
+            default:              value = va_arg( vaptr, int );              break;
+            }
+            memcpy( p, &value, sizeof( value ) );
+            p += sizeof( value );
+            break;
+
+        case kBinArgUnsigned:
+            switch ( conv.length )
+            {
+            case kBinLenChar:     value = (unsigned char)va_arg( vaptr, unsigned int );  break;
+            case kBinLenShort:    value = (unsigned short)va_arg( vaptr, unsigned int ); break;
+            case kBinLenLong:     value = va_arg( vaptr, unsigned long );                break;
+            case kBinLenLongLong: value = va_arg( vaptr, unsigned long long );           break;
+            case kBinLenIntMax:   value = va_arg( vaptr, uintmax_t );                    break;
+            case kBinLenSize:     value = va_arg( vaptr, size_t );                       break;
+            case kBinLenPtrDiff:  value = va_arg( vaptr, ptrdiff_t );                    break;
+            default:              value = va_arg( vaptr, unsigned int );                 break;
+            }
+            memcpy( p, &value, sizeof( value ) );
+            p += sizeof( value );
+            break;
+
+        case kBinArgDouble:
+            if ( conv.length == kBinLenLongDouble )
+                { real = va_arg( vaptr, long double ); }
+            else
+                { real = va_arg( vaptr, double ); }
+            memcpy( p, &real, sizeof( real ) );
+            p += sizeof( real );
+            break;
+
+        case kBinArgPointer:
+            value = (uintptr_t)va_arg( vaptr, void * );
+            memcpy( p, &value, sizeof( value ) );
+            p += sizeof( value );
+            break;
+
+        case kBinArgErrno:
+            value = savedErrno;
+            memcpy( p, &value, sizeof( value ) );
+            p += sizeof( value );
+            break;
+
+        case kBinArgString:
+            string = va_arg( vaptr, const char * );
+            if ( string == NULL )
+            {
+                string = "(null)";
+            }
+            /* with a precision, the argument needn't be terminated */
+            maxLength = kBinLogMaxString;
+            if ( conv.precision >= 0 && conv.precision < kBinLogMaxString )
+            {
+                maxLength = conv.precision;
+            }
+            length = strnlen( string, maxLength );
+            /* leave room for the fixed-size arguments that may follow */
+            if ( length > limit - p - 1024 )
+            {
+                length = (limit - p > 1024) ? limit - p - 1024 : 0;
+            }
+            memcpy( p, &length, sizeof( length ) );
+            p += sizeof( length );
+            memcpy( p, string, length );
+            p += length;
+            break;
+
+        default:
+            break;
+        }
+
+        /* a pathological format string; drop the rest of the arguments */
+        if ( limit - p < 64 )
+        {
+            break;
+        }
+    }
+
+    msg.type      = kBinLogMessage;
+    msg.priority  = priority;
+    msg.scope     = scope;
+    msg.line      = atLine;
+    msg.timestamp = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    msg.format    = (uintptr_t)format;
+    msg.file      = (uintptr_t)inFile;
+    msg.argBytes  = p - (start + sizeof( msg ));
+    memcpy( start, &msg, sizeof( msg ) );
+
+    binLog->used += p - start;
+}
+
+void _logBinaryf(const char *inFile, unsigned int atLine, unsigned int scope, unsigned int priority, const char *format, ...)
+{
+    va_list vaptr;
+
+    va_start(vaptr, format);
+    _logBinary( inFile, atLine, scope, priority, format, vaptr );
+    va_end(vaptr);
 }
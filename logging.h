@@ -6,6 +6,7 @@
 #define LOGGING_H
 
 #include    <syslog.h>
+#include    <sys/types.h>
 
 /* this is dynamically built by the Makefile */
 #include "obj/logscopes.inc"
@@ -33,7 +34,7 @@ typedef struct {
 
 extern gLogEntry gLog[kMaxLogScope];
 
-typedef enum { kLogToUndefined, kLogToSyslog, kLogToFile, kLogToStderr } eLogDestination;
+typedef enum { kLogToUndefined, kLogToSyslog, kLogToFile, kLogToStderr, kLogToBinary } eLogDestination;
 
 /* set up the logging mechanisms. Call once, very early. */
 void    initLogging( const char *name );
@@ -41,6 +42,29 @@ void    initLogging( const char *name );
 /* configure the logging mechanisms, may be called multiple times */
 void    startLogging( tPriority debugLevel, const char *logFile );
 
+/* as above, but with an explicit destination. kLogToBinary records the raw
+   arguments to logFile without formatting them - use fflogdump to read it */
+void    startLoggingTo( tPriority debugLevel, eLogDestination logDest, const char *logFile );
+
+/* write out anything the calling thread has buffered (binary logging only).
+   A thread's buffer is also written out when it exits, and stopLogging()
+   writes out every thread's */
+void    logFlush( void );
+
+/* set the runtime level for one scope (a kLog_<scope> value) */
+void    setLogLevel( int logScope, tPriority level );
+
+/* apply settings like 'config=debug all=notice trace=on', separated by
+   whitespace or commas. Returns -1 if any of them weren't understood */
+int     logControl( const char *settings, size_t length );
+
+/* live control: enableLogControl() prepares the SIGUSR1 handler, logControlSignal(),
+   which applies the settings another process left for us with sendLogControl() */
+void    enableLogControl( void );
+void    logControlSignal( int signal );
+int     sendLogControl( pid_t pid, int argc, const char *argv[] );
+void    logControlPath( pid_t pid, char *path, size_t size );
+
 /* tidy up the current logging mechanism */
 void    stopLogging( void );
 
@@ -51,10 +75,10 @@ static inline void logFunctionTraceOn() { gFunctionTraceEnabled = 1; };
 static inline void logFunctionTraceOff() { gFunctionTraceEnabled = 0; };
 
 /* private helpers, used by preprocessor macros. Please don't use directly! */
-void    _log( tPriority priority, const char *format, ...)
-            __attribute__((__format__ (__printf__, 2, 3))) __attribute__((no_instrument_function));
-void    _logWithLocation( const char *inFile, unsigned int atLine, tPriority priority, const char *format, ...)
-            __attribute__((__format__ (__printf__, 4, 5))) __attribute__((no_instrument_function));
+void    _log( eLogScope scope, tPriority priority, const char *format, ...)
+            __attribute__((__format__ (__printf__, 3, 4))) __attribute__((no_instrument_function));
+void    _logWithLocation( const char *inFile, unsigned int atLine, eLogScope scope, tPriority priority, const char *format, ...)
+            __attribute__((__format__ (__printf__, 5, 6))) __attribute__((no_instrument_function));
 
 #define logEmergency(...)   logWithLocation(kLogEmergency, __VA_ARGS__ )
 #define logAlert(...)       logWithLocation(kLogAlert,     __VA_ARGS__ )
@@ -66,18 +90,29 @@ void    _logWithLocation( const char *inFile, unsigned int atLine, tPriority pri
 
 #ifndef RELEASE_BUILD
 # define logDebug(...)      logWithLocation( kLogDebug, __VA_ARGS__ )
-# define logCheckpoint()    do { _log( __FILE__, __LINE__, kLogDebug, "reached" ); } while (0)
+# define logCheckpoint()    logWithLocation( kLogDebug, "reached" )
 #else
 # define logDebug(...)      do {} while (0)
 # define logCheckpoint()    do {} while (0)
 #endif
 
-#define logCheck_expand_again(priority, scope)  ( gLog[kLog_##scope].level >= priority )
-#define logCheck(priority, scope)       logCheck_expand_again(priority, scope)
+#define logScope_expand_again(scope)    kLog_##scope
+#define logScope(scope)                 logScope_expand_again(scope)
+
+/* a call site below the floor set for its scope at build time (kLogFloor_<scope>,
+   in logscopes.inc) is a constant false, so the compiler drops it entirely */
+#define logFloor_expand_again(priority, scope)  ( kLogFloor_##scope >= priority )
+#define logFloor(priority, scope)       logFloor_expand_again(priority, scope)
+
+/* the runtime test on its own, without the floor */
+#define logCheckRuntime_expand_again(priority, scope)  ( gLog[kLog_##scope].level >= priority )
+#define logCheckRuntime(priority, scope)    logCheckRuntime_expand_again(priority, scope)
+
+#define logCheck(priority, scope)       ( logFloor(priority, scope) && logCheckRuntime(priority, scope) )
 //#define logCheck(priority, scope)       1
 
-#define log(priority, ...)              do { if (  logCheck( priority, LOG_SCOPE ) ) _log( priority, __VA_ARGS__ ); } while (0)
-#define logWithLocation(priority, ...)  do { if (  logCheck( priority, LOG_SCOPE ) ) _logWithLocation( __FILE__, __LINE__, priority, __VA_ARGS__ ); } while (0)
+#define log(priority, ...)              do { if (  logCheck( priority, LOG_SCOPE ) ) _log( logScope( LOG_SCOPE ), priority, __VA_ARGS__ ); } while (0)
+#define logWithLocation(priority, ...)  do { if (  logCheck( priority, LOG_SCOPE ) ) _logWithLocation( __FILE__, __LINE__, logScope( LOG_SCOPE ), priority, __VA_ARGS__ ); } while (0)
 
 #endif
 
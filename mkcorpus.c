@@ -0,0 +1,914 @@
+/*
+    Generates a deterministic corpus of media files for benchmarking fftest,
+    so nobody has to ship real media around.
+
+    usage: mkcorpus [-s <scale>] [-H <MB>] <directory>
+        -s  multiply every duration by <scale> (default 1)
+        -H  size of the huge Matroska file, in MB (default 512)
+
+    Everything is written with the libavformat muxers. Streams are encoded
+    with whichever libavcodec encoders are available (single threaded and
+    bit-exact, so the output is repeatable); codecs with no encoder get a
+    synthetic payload of the right shape - valid container, packets of
+    plausible size, contents that won't decode.
+
+    The corpus covers:
+        normal      most containers x video codecs, and audio-only files
+        faststart   MP4 with the moov atom at the front (the others have it at the end)
+        tiny        empty files, header-only files, single frames
+        huge        a large Matroska file, and a long one with a big index
+        truncated   copies of normal files, cut short
+        corrupt     copies of normal files, with bytes flipped
+
+    <directory>/MANIFEST.tsv lists each file and its kind, for ffbench.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+
+#include "common.h"
+#include "logging.h"
+
+const char *  gExecName;  /* base name of the executable, derived from argv[0] */
+
+#define kFrameRate      25
+#define kSampleRate     48000
+
+typedef enum { kKindNormal, kKindFaststart, kKindTiny, kKindHuge, kKindTruncated, kKindCorrupt } eKind;
+
+static const char *kindStrings[] = {
+    [kKindNormal]    = "normal",
+    [kKindFaststart] = "faststart",
+    [kKindTiny]      = "tiny",
+    [kKindHuge]      = "huge",
+    [kKindTruncated] = "truncated",
+    [kKindCorrupt]   = "corrupt"
+};
+
+typedef struct {
+    const char     *format;         /* muxer short name */
+    const char     *extension;
+    const char     *movflags;       /* or NULL */
+} tContainer;
+
+static const tContainer containers[] = {
+    { "mp4",      "mp4",  NULL },
+    { "mp4",      "mp4",  "+faststart" },
+    { "mov",      "mov",  NULL },
+    { "matroska", "mkv",  NULL },
+    { "webm",     "webm", NULL },
+    { "avi",      "avi",  NULL },
+    { "mpegts",   "ts",   NULL },
+    { "flv",      "flv",  NULL },
+    { "nut",      "nut",  NULL },
+    { "asf",      "wmv",  NULL },
+    { NULL }
+};
+
+static const enum AVCodecID videoCodecs[] = {
+    AV_CODEC_ID_H264, AV_CODEC_ID_HEVC, AV_CODEC_ID_MPEG4, AV_CODEC_ID_MPEG2VIDEO,
+    AV_CODEC_ID_MJPEG, AV_CODEC_ID_VP9, AV_CODEC_ID_AV1,
+    AV_CODEC_ID_NONE
+};
+
+static const enum AVCodecID audioCodecs[] = {
+    AV_CODEC_ID_AAC, AV_CODEC_ID_AC3, AV_CODEC_ID_MP3, AV_CODEC_ID_MP2, AV_CODEC_ID_FLAC,
+    AV_CODEC_ID_ALAC, AV_CODEC_ID_PCM_S16LE, AV_CODEC_ID_OPUS, AV_CODEC_ID_VORBIS,
+    AV_CODEC_ID_NONE
+};
+
+typedef struct { int width, height; } tSize;
+
+static const tSize sizes[] = {
+    { 320, 240 }, { 640, 360 }, { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 }
+};
+
+static const int durations[] = { 1, 4, 10 };   /* seconds */
+
+/* what one file should contain */
+typedef struct {
+    const tContainer   *container;
+    enum AVCodecID      video;          /* AV_CODEC_ID_NONE for audio-only */
+    enum AVCodecID      audio;          /* AV_CODEC_ID_NONE for video-only */
+    int                 width, height;
+    int64_t             frames;         /* of video, or the equivalent duration of audio */
+    int                 synthetic;      /* force a synthetic payload, even if there's an encoder */
+    int                 packetBytes;    /* synthetic video packet size, 0 picks one from the size */
+} tSpec;
+
+static FILE        *manifest;
+static double       scale    = 1.0;
+static int          hugeMB   = 512;
+
+/*
+ * a small deterministic PRNG (xorshift64*), so the corpus is the same every time
+ */
+static uint64_t _random( uint64_t *state )
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+ * one output stream: either an encoder, or a source of synthetic packets
+ */
+typedef struct {
+    AVStream           *stream;
+    AVCodecContext     *encoder;        /* NULL for synthetic */
+    AVFrame            *frame;
+    enum AVMediaType    type;
+    AVRational          timeBase;
+    int64_t             next;           /* pts of the next frame, in timeBase */
+    int64_t             end;            /* stop at this pts */
+    int                 samplesPerPacket;
+    int                 packetBytes;
+    uint64_t            random;
+} tOutput;
+
+static int _pickPixelFormat( const AVCodec *codec )
+{
+    static const enum AVPixelFormat preferred[] = { AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_NONE };
+
+    if ( codec->pix_fmts == NULL )
+    {
+        return AV_PIX_FMT_YUV420P;
+    }
+    for ( int i = 0; preferred[i] != AV_PIX_FMT_NONE; ++i )
+    {
+        for ( const enum AVPixelFormat *p = codec->pix_fmts; *p != AV_PIX_FMT_NONE; ++p )
+        {
+            if ( *p == preferred[i] )
+            {
+                return *p;
+            }
+        }
+    }
+    return AV_PIX_FMT_NONE;
+}
+
+static void _setStereo( AVChannelLayout *layout )
+{
+    av_channel_layout_default( layout, 2 );
+}
+
+/* set up an encoder for the output, or return -1 if there isn't a suitable one */
+static int _openEncoder( AVFormatContext *mux, tOutput *output, const tSpec *spec )
+{
+    const AVCodec  *codec;
+    AVCodecContext *ctx;
+    int             err;
+
+    codec = avcodec_find_encoder( (output->type == AVMEDIA_TYPE_VIDEO) ? spec->video : spec->audio );
+    if ( codec == NULL || spec->synthetic )
+    {
+        return -1;
+    }
+
+    ctx = avcodec_alloc_context3( codec );
+    if ( ctx == NULL )
+    {
+        return -1;
+    }
+    ctx->thread_count          = 1;
+    ctx->flags                |= AV_CODEC_FLAG_BITEXACT;
+    ctx->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;    /* opus & vorbis */
+    ctx->time_base             = output->timeBase;
+
+    if ( output->type == AVMEDIA_TYPE_VIDEO )
+    {
+        ctx->width     = spec->width;
+        ctx->height    = spec->height;
+        ctx->pix_fmt   = _pickPixelFormat( codec );
+        ctx->framerate = (AVRational){ kFrameRate, 1 };
+        ctx->gop_size  = kFrameRate * 2;
+        ctx->bit_rate  = (int64_t)spec->width * spec->height * 3;  /* roughly 0.12 bits/pixel */
+        if ( ctx->pix_fmt == AV_PIX_FMT_NONE )
+        {
+            avcodec_free_context( &ctx );
+            return -1;
+        }
+    }
+    else
+    {
+        ctx->sample_rate = kSampleRate;
+        ctx->sample_fmt  = (codec->sample_fmts != NULL) ? codec->sample_fmts[0] : AV_SAMPLE_FMT_S16;
+        ctx->bit_rate    = 192000;
+        _setStereo( &ctx->ch_layout );
+    }
+
+    if ( mux->oformat->flags & AVFMT_GLOBALHEADER )
+    {
+        ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    err = avcodec_open2( ctx, codec, NULL );
+    if ( err < 0 )
+    {
+        logDebug( "unable to open the %s encoder (%s)", codec->name, av_err2str( err ) );
+        avcodec_free_context( &ctx );
+        return -1;
+    }
+
+    err = avcodec_parameters_from_context( output->stream->codecpar, ctx );
+    if ( err < 0 )
+    {
+        avcodec_free_context( &ctx );
+        return -1;
+    }
+
+    output->frame = av_frame_alloc();
+    if ( output->frame == NULL )
+    {
+        avcodec_free_context( &ctx );
+        return -1;
+    }
+    if ( output->type == AVMEDIA_TYPE_VIDEO )
+    {
+        output->frame->format = ctx->pix_fmt;
+        output->frame->width  = ctx->width;
+        output->frame->height = ctx->height;
+    }
+    else
+    {
+        output->samplesPerPacket = (ctx->frame_size > 0) ? ctx->frame_size : 1024;
+        output->frame->format      = ctx->sample_fmt;
+        output->frame->nb_samples  = output->samplesPerPacket;
+        output->frame->sample_rate = ctx->sample_rate;
+        av_channel_layout_copy( &output->frame->ch_layout, &ctx->ch_layout );
+    }
+    if ( av_frame_get_buffer( output->frame, 0 ) < 0 )
+    {
+        av_frame_free( &output->frame );
+        avcodec_free_context( &ctx );
+        return -1;
+    }
+
+    output->encoder = ctx;
+    return 0;
+}
+
+/* no encoder: describe the stream ourselves, and make up packets later */
+static void _openSynthetic( tOutput *output, const tSpec *spec )
+{
+    AVCodecParameters *par = output->stream->codecpar;
+
+    par->codec_type = output->type;
+    if ( output->type == AVMEDIA_TYPE_VIDEO )
+    {
+        par->codec_id = spec->video;
+        par->width    = spec->width;
+        par->height   = spec->height;
+        par->format   = AV_PIX_FMT_YUV420P;
+        output->packetBytes = (spec->packetBytes != 0) ? spec->packetBytes : spec->width * spec->height / 64 + 64;
+        if ( spec->video == AV_CODEC_ID_RAWVIDEO )
+        {
+            output->packetBytes = spec->width * spec->height * 3 / 2;
+        }
+        par->bit_rate = (int64_t)output->packetBytes * 8 * kFrameRate;
+    }
+    else
+    {
+        par->codec_id    = spec->audio;
+        par->sample_rate = kSampleRate;
+        par->format      = AV_SAMPLE_FMT_S16;
+        _setStereo( &par->ch_layout );
+        /* an MP3 frame is 1152 samples, everything else gets 1024 */
+        output->samplesPerPacket = (spec->audio == AV_CODEC_ID_MP3) ? 1152 : 1024;
+        output->packetBytes      = (spec->audio == AV_CODEC_ID_MP3) ? 384 : 768;
+        par->frame_size = output->samplesPerPacket;
+        par->bit_rate   = (int64_t)output->packetBytes * 8 * kSampleRate / output->samplesPerPacket;
+    }
+}
+
+/* draw a moving gradient, with some noise so it doesn't compress to nothing */
+static void _fillVideo( AVFrame *frame, int64_t index, uint64_t *random )
+{
+    int plane, x, y, w, h;
+
+    av_frame_make_writable( frame );
+    for ( plane = 0; plane < 3; ++plane )
+    {
+        w = (plane == 0) ? frame->width  : (frame->width  + 1) / 2;
+        h = (plane == 0) ? frame->height : (frame->height + 1) / 2;
+        for ( y = 0; y < h; ++y )
+        {
+            uint8_t *row = frame->data[plane] + (size_t)y * frame->linesize[plane];
+            for ( x = 0; x < w; ++x )
+            {
+                row[x] = (plane == 0) ? (uint8_t)(x + y + index * 3) : (uint8_t)(128 + plane * 16 + (y >> 3));
+            }
+            if ( plane == 0 && (y & 15) == 0 )
+            {
+                row[_random( random ) % w] = _random( random );
+            }
+        }
+    }
+}
+
+/* two sine tones, one per channel, in whatever sample format the encoder wants */
+static void _fillAudio( AVFrame *frame, int64_t firstSample )
+{
+    int         planar = av_sample_fmt_is_planar( frame->format );
+    int         channels = frame->ch_layout.nb_channels;
+    double      value;
+
+    av_frame_make_writable( frame );
+    for ( int i = 0; i < frame->nb_samples; ++i )
+    {
+        for ( int c = 0; c < channels; ++c )
+        {
+            value = 0.25 * sin( 2 * M_PI * (440.0 + 110 * c) * (firstSample + i) / kSampleRate );
+
+            int      plane = planar ? c : 0;
+            int      index = planar ? i : i * channels + c;
+            uint8_t *data  = frame->extended_data[plane];
+
+            switch ( frame->format )
+            {
+            case AV_SAMPLE_FMT_S16:
+            case AV_SAMPLE_FMT_S16P: ((int16_t *)data)[index] = value * INT16_MAX; break;
+            case AV_SAMPLE_FMT_S32:
+            case AV_SAMPLE_FMT_S32P: ((int32_t *)data)[index] = value * INT32_MAX; break;
+            case AV_SAMPLE_FMT_FLT:
+            case AV_SAMPLE_FMT_FLTP: ((float *)data)[index]   = value;             break;
+            case AV_SAMPLE_FMT_DBL:
+            case AV_SAMPLE_FMT_DBLP: ((double *)data)[index]  = value;             break;
+            default:                 break;
+            }
+        }
+    }
+}
+
+static int _writeEncoded( AVFormatContext *mux, tOutput *output, AVPacket *packet )
+{
+    int err;
+
+    while ( (err = avcodec_receive_packet( output->encoder, packet )) >= 0 )
+    {
+        av_packet_rescale_ts( packet, output->encoder->time_base, output->stream->time_base );
+        packet->stream_index = output->stream->index;
+        err = av_interleaved_write_frame( mux, packet );
+        if ( err < 0 )
+        {
+            return err;
+        }
+    }
+    return (err == AVERROR( EAGAIN ) || err == AVERROR_EOF) ? 0 : err;
+}
+
+static int _writeSynthetic( AVFormatContext *mux, tOutput *output, AVPacket *packet )
+{
+    int         size = output->packetBytes;
+    int         key;
+    int         err;
+
+    if ( output->type == AVMEDIA_TYPE_VIDEO )
+    {
+        key = (output->next % (kFrameRate * 2)) == 0;
+        if ( !key && output->packetBytes > 256 )
+        {
+            size = output->packetBytes / 4 + _random( &output->random ) % (output->packetBytes / 4);
+        }
+    }
+    else
+    {
+        key = 1;
+    }
+
+    err = av_new_packet( packet, size );
+    if ( err < 0 )
+    {
+        return err;
+    }
+
+    if ( output->type == AVMEDIA_TYPE_AUDIO && output->stream->codecpar->codec_id == AV_CODEC_ID_MP3 )
+    {
+        /* a real MPEG-1 layer III header (128kbit/s, 48kHz, stereo) with silence behind it */
+        memset( packet->data, 0, size );
+        packet->data[0] = 0xFF; packet->data[1] = 0xFB; packet->data[2] = 0x94; packet->data[3] = 0x04;
+    }
+    else if ( output->stream->codecpar->codec_id == AV_CODEC_ID_RAWVIDEO )
+    {
+        memset( packet->data, (int)(output->next & 0xFF), size );
+    }
+    else
+    {
+        for ( int i = 0; i < size; i += 8 )
+        {
+            uint64_t r = _random( &output->random );
+            memcpy( &packet->data[i], &r, (size - i < 8) ? size - i : 8 );
+        }
+        /* the MPEG-TS muxer insists on Annex B start codes */
+        if ( strcmp( mux->oformat->name, "mpegts" ) == 0 && size > 5 )
+        {
+            packet->data[0] = 0; packet->data[1] = 0; packet->data[2] = 0; packet->data[3] = 1;
+        }
+    }
+
+    packet->pts = packet->dts = output->next;
+    packet->duration     = (output->type == AVMEDIA_TYPE_VIDEO) ? 1 : output->samplesPerPacket;
+    packet->flags        = key ? AV_PKT_FLAG_KEY : 0;
+    packet->stream_index = output->stream->index;
+    av_packet_rescale_ts( packet, output->timeBase, output->stream->time_base );
+
+    return av_interleaved_write_frame( mux, packet );
+}
+
+/* produce the next frame (or packet) of an output */
+static int _step( AVFormatContext *mux, tOutput *output, AVPacket *packet )
+{
+    int err;
+
+    if ( output->encoder == NULL )
+    {
+        err = _writeSynthetic( mux, output, packet );
+        output->next += (output->type == AVMEDIA_TYPE_VIDEO) ? 1 : output->samplesPerPacket;
+        return err;
+    }
+
+    if ( output->type == AVMEDIA_TYPE_VIDEO )
+    {
+        _fillVideo( output->frame, output->next, &output->random );
+        output->frame->pts = output->next++;
+    }
+    else
+    {
+        _fillAudio( output->frame, output->next );
+        output->frame->pts = output->next;
+        output->next += output->samplesPerPacket;
+    }
+
+    err = avcodec_send_frame( output->encoder, output->frame );
+    if ( err < 0 )
+    {
+        return err;
+    }
+    return _writeEncoded( mux, output, packet );
+}
+
+static void _closeOutput( tOutput *output )
+{
+    av_frame_free( &output->frame );
+    avcodec_free_context( &output->encoder );
+}
+
+/* write one file. Returns 0 on success */
+static int writeFile( const char *path, const tSpec *spec )
+{
+    AVFormatContext    *mux = NULL;
+    AVDictionary       *options = NULL;
+    AVPacket           *packet;
+    tOutput             outputs[2];
+    int                 count = 0;
+    int                 err;
+    tOutput            *next;
+
+    memset( outputs, 0, sizeof( outputs ) );
+
+    err = avformat_alloc_output_context2( &mux, NULL, spec->container->format, path );
+    if ( err < 0 )
+    {
+        logError( "no %s muxer (%s)", spec->container->format, av_err2str( err ) );
+        return err;
+    }
+    /* no random UIDs or version strings, so the output is the same every time */
+    mux->flags |= AVFMT_FLAG_BITEXACT;
+
+    packet = av_packet_alloc();
+    if ( packet == NULL )
+    {
+        avformat_free_context( mux );
+        return AVERROR( ENOMEM );
+    }
+
+    if ( spec->video != AV_CODEC_ID_NONE )
+    {
+        outputs[count].type     = AVMEDIA_TYPE_VIDEO;
+        outputs[count].timeBase = (AVRational){ 1, kFrameRate };
+        outputs[count].end      = spec->frames;
+        ++count;
+    }
+    if ( spec->audio != AV_CODEC_ID_NONE )
+    {
+        outputs[count].type     = AVMEDIA_TYPE_AUDIO;
+        outputs[count].timeBase = (AVRational){ 1, kSampleRate };
+        outputs[count].end      = spec->frames * kSampleRate / kFrameRate;
+        ++count;
+    }
+
+    for ( int i = 0; i < count; ++i )
+    {
+        outputs[i].random = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)spec->width << 32) ^ (spec->frames * 7919 + i);
+        outputs[i].stream = avformat_new_stream( mux, NULL );
+        if ( outputs[i].stream == NULL )
+        {
+            err = AVERROR( ENOMEM );
+            goto done;
+        }
+        outputs[i].stream->time_base = outputs[i].timeBase;
+        if ( _openEncoder( mux, &outputs[i], spec ) != 0 )
+        {
+            _openSynthetic( &outputs[i], spec );
+        }
+    }
+
+    if ( !(mux->oformat->flags & AVFMT_NOFILE) )
+    {
+        err = avio_open( &mux->pb, path, AVIO_FLAG_WRITE );
+        if ( err < 0 )
+        {
+            logError( "unable to create \"%s\" (%s)", path, av_err2str( err ) );
+            goto done;
+        }
+    }
+
+    if ( spec->container->movflags != NULL )
+    {
+        av_dict_set( &options, "movflags", spec->container->movflags, 0 );
+    }
+    err = avformat_write_header( mux, &options );
+    av_dict_free( &options );
+    if ( err < 0 )
+    {
+        logInfo( "%s won't take this combination (%s), skipped", spec->container->format, av_err2str( err ) );
+        goto done;
+    }
+
+    /* write the streams interleaved, always advancing whichever is furthest behind */
+    for ( ;; )
+    {
+        next = NULL;
+        for ( int i = 0; i < count; ++i )
+        {
+            if ( outputs[i].next < outputs[i].end
+              && (next == NULL || av_compare_ts( outputs[i].next, outputs[i].timeBase, next->next, next->timeBase ) < 0) )
+            {
+                next = &outputs[i];
+            }
+        }
+        if ( next == NULL )
+        {
+            break;
+        }
+        err = _step( mux, next, packet );
+        if ( err < 0 )
+        {
+            logInfo( "unable to write to \"%s\" (%s)", path, av_err2str( err ) );
+            goto done;
+        }
+    }
+
+    /* drain the encoders */
+    for ( int i = 0; i < count; ++i )
+    {
+        if ( outputs[i].encoder != NULL )
+        {
+            avcodec_send_frame( outputs[i].encoder, NULL );
+            _writeEncoded( mux, &outputs[i], packet );
+        }
+    }
+
+    err = av_write_trailer( mux );
+
+done:
+    for ( int i = 0; i < count; ++i )
+    {
+        _closeOutput( &outputs[i] );
+    }
+    av_packet_free( &packet );
+    if ( !(mux->oformat->flags & AVFMT_NOFILE) )
+    {
+        avio_closep( &mux->pb );
+    }
+    avformat_free_context( mux );
+
+    if ( err < 0 )
+    {
+        unlink( path );
+    }
+    return err;
+}
+
+static void record( eKind kind, const char *path )
+{
+    fprintf( manifest, "%s\t%s\n", kindStrings[kind], path );
+}
+
+static int copyFile( const char *from, const char *to, off_t length )
+{
+    char    buffer[64 * 1024];
+    FILE   *in, *out;
+    size_t  count;
+    int     result = 0;
+
+    in  = fopen( from, "rb" );
+    out = fopen( to, "wb" );
+    if ( in == NULL || out == NULL )
+    {
+        result = -1;
+    }
+    while ( result == 0 && length > 0 && (count = fread( buffer, 1, (length < (off_t)sizeof( buffer )) ? (size_t)length : sizeof( buffer ), in )) > 0 )
+    {
+        if ( fwrite( buffer, 1, count, out ) != count )
+        {
+            result = -1;
+        }
+        length -= count;
+    }
+    if ( in  != NULL ) fclose( in );
+    if ( out != NULL && fclose( out ) != 0 ) result = -1;
+
+    return result;
+}
+
+/* the truncated and corrupt copies of a normal file */
+static void damage( const char *directory, const char *path, const char *name, uint64_t *random )
+{
+    char        damaged[1024];
+    struct stat st;
+    FILE       *file;
+    off_t       offset;
+
+    if ( stat( path, &st ) != 0 || st.st_size < 1024 )
+    {
+        return;
+    }
+
+    /* cut off somewhere in the middle third */
+    snprintf( damaged, sizeof( damaged ), "%s/truncated-%s", directory, name );
+    if ( copyFile( path, damaged, st.st_size / 3 + _random( random ) % (st.st_size / 3) ) == 0 )
+    {
+        record( kKindTruncated, damaged );
+    }
+
+    /* flip bytes, mostly in the first 64K where the headers live */
+    snprintf( damaged, sizeof( damaged ), "%s/corrupt-%s", directory, name );
+    if ( copyFile( path, damaged, st.st_size ) == 0 && (file = fopen( damaged, "r+b" )) != NULL )
+    {
+        for ( int i = 0; i < 32; ++i )
+        {
+            offset = (i < 16 && st.st_size > 65536) ? _random( random ) % 65536 : _random( random ) % st.st_size;
+            fseeko( file, offset, SEEK_SET );
+            fputc( (int)(_random( random ) & 0xFF), file );
+        }
+        fclose( file );
+        record( kKindCorrupt, damaged );
+    }
+}
+
+static int supports( const AVOutputFormat *format, enum AVCodecID codec )
+{
+    /* < 0 means the muxer doesn't say, so try it */
+    return avformat_query_codec( format, codec, FF_COMPLIANCE_EXPERIMENTAL ) != 0;
+}
+
+static void makeNormal( const char *directory )
+{
+    const tContainer       *container;
+    const AVOutputFormat   *format;
+    tSpec                   spec;
+    char                    name[256], path[1024];
+    uint64_t                random = 1;
+    int                     serial = 0, audioIndex = 0;
+
+    for ( container = containers; container->format != NULL; ++container )
+    {
+        format = av_guess_format( container->format, NULL, NULL );
+        if ( format == NULL )
+        {
+            logWarning( "this libavformat has no %s muxer", container->format );
+            continue;
+        }
+
+        memset( &spec, 0, sizeof( spec ) );
+        spec.container = container;
+
+        /* every video codec the container takes, with a rotating choice of audio */
+        for ( int v = 0; videoCodecs[v] != AV_CODEC_ID_NONE; ++v )
+        {
+            if ( !supports( format, videoCodecs[v] ) )
+            {
+                continue;
+            }
+            spec.video = videoCodecs[v];
+            spec.audio = AV_CODEC_ID_NONE;
+            for ( int tries = 0; audioCodecs[tries] != AV_CODEC_ID_NONE; ++tries )
+            {
+                enum AVCodecID audio = audioCodecs[(audioIndex + tries) % (sizeof( audioCodecs ) / sizeof( audioCodecs[0] ) - 1)];
+                if ( supports( format, audio ) )
+                {
+                    spec.audio = audio;
+                    break;
+                }
+            }
+            ++audioIndex;
+
+            const tSize *size = &sizes[_random( &random ) % (sizeof( sizes ) / sizeof( sizes[0] ))];
+            int seconds = durations[_random( &random ) % (sizeof( durations ) / sizeof( durations[0] ))];
+            if ( size->width > 1920 )
+            {
+                seconds = 1;    /* keep the encoding time down */
+            }
+            spec.width  = size->width;
+            spec.height = size->height;
+            spec.frames = lrint( seconds * scale * kFrameRate );
+            if ( spec.frames < 1 )
+            {
+                spec.frames = 1;
+            }
+
+            snprintf( name, sizeof( name ), "%03d-%s-%s-%s-%dx%d.%s", serial++,
+                      container->format, avcodec_get_name( spec.video ),
+                      (spec.audio != AV_CODEC_ID_NONE) ? avcodec_get_name( spec.audio ) : "none",
+                      spec.width, spec.height, container->extension );
+            snprintf( path, sizeof( path ), "%s/%s", directory, name );
+            logNotice( "%s", name );
+
+            if ( writeFile( path, &spec ) == 0 )
+            {
+                record( (container->movflags != NULL) ? kKindFaststart : kKindNormal, path );
+                if ( serial % 4 == 0 )
+                {
+                    damage( directory, path, name, &random );
+                }
+            }
+        }
+
+        /* and audio-only */
+        spec.video  = AV_CODEC_ID_NONE;
+        spec.width  = spec.height = 0;
+        for ( int a = 0; audioCodecs[a] != AV_CODEC_ID_NONE; ++a )
+        {
+            if ( !supports( format, audioCodecs[a] ) )
+            {
+                continue;
+            }
+            spec.audio  = audioCodecs[a];
+            spec.frames = lrint( durations[a % 3] * 6 * scale * kFrameRate );
+
+            snprintf( name, sizeof( name ), "%03d-%s-audio-%s.%s", serial++,
+                      container->format, avcodec_get_name( spec.audio ), container->extension );
+            snprintf( path, sizeof( path ), "%s/%s", directory, name );
+            logNotice( "%s", name );
+
+            if ( writeFile( path, &spec ) == 0 )
+            {
+                record( (container->movflags != NULL) ? kKindFaststart : kKindNormal, path );
+            }
+        }
+    }
+}
+
+static void makeTiny( const char *directory )
+{
+    static const tContainer mp4 = { "mp4", "mp4", NULL }, mkv = { "matroska", "mkv", NULL }, ts = { "mpegts", "ts", NULL };
+    static const tContainer *tinyContainers[] = { &mp4, &mkv, &ts, NULL };
+    tSpec       spec;
+    char        path[1024];
+    FILE       *file;
+
+    /* empty, and a few bytes of nothing in particular */
+    snprintf( path, sizeof( path ), "%s/tiny-empty.mp4", directory );
+    file = fopen( path, "wb" );
+    if ( file != NULL )
+    {
+        fclose( file );
+        record( kKindTiny, path );
+    }
+    snprintf( path, sizeof( path ), "%s/tiny-garbage.mkv", directory );
+    file = fopen( path, "wb" );
+    if ( file != NULL )
+    {
+        for ( int i = 0; i < 100; ++i ) { fputc( (i * 37) & 0xFF, file ); }
+        fclose( file );
+        record( kKindTiny, path );
+    }
+
+    for ( int i = 0; tinyContainers[i] != NULL; ++i )
+    {
+        memset( &spec, 0, sizeof( spec ) );
+        spec.container = tinyContainers[i];
+        spec.video     = AV_CODEC_ID_MPEG4;
+        spec.audio     = AV_CODEC_ID_AAC;
+        spec.width     = 160;
+        spec.height    = 120;
+
+        /* headers, but no packets */
+        spec.frames = 0;
+        snprintf( path, sizeof( path ), "%s/tiny-header-only.%s", directory, spec.container->extension );
+        if ( writeFile( path, &spec ) == 0 )
+            { record( kKindTiny, path ); }
+
+        /* a single frame */
+        spec.frames = 1;
+        snprintf( path, sizeof( path ), "%s/tiny-one-frame.%s", directory, spec.container->extension );
+        if ( writeFile( path, &spec ) == 0 )
+            { record( kKindTiny, path ); }
+    }
+}
+
+static void makeHuge( const char *directory )
+{
+    static const tContainer mkv = { "matroska", "mkv", NULL };
+    tSpec       spec;
+    char        path[1024];
+
+    /* big: uncompressed 1080p, so it costs I/O rather than encoding time */
+    memset( &spec, 0, sizeof( spec ) );
+    spec.container = &mkv;
+    spec.video     = AV_CODEC_ID_RAWVIDEO;
+    spec.audio     = AV_CODEC_ID_PCM_S16LE;
+    spec.width     = 1920;
+    spec.height    = 1080;
+    spec.synthetic = 1;
+    spec.frames    = (int64_t)hugeMB * 1024 * 1024 / (1920 * 1080 * 3 / 2);
+    snprintf( path, sizeof( path ), "%s/huge-rawvideo-%dMB.mkv", directory, hugeMB );
+    logNotice( "%s", path );
+    if ( writeFile( path, &spec ) == 0 )
+        { record( kKindHuge, path ); }
+
+    /* long: two hours of small packets, so the index at the end is large */
+    spec.video       = AV_CODEC_ID_H264;
+    spec.audio       = AV_CODEC_ID_MP3;
+    spec.width       = 640;
+    spec.height      = 360;
+    spec.packetBytes = 512;
+    spec.frames      = lrint( 2 * 60 * 60 * kFrameRate * scale );
+    snprintf( path, sizeof( path ), "%s/huge-two-hours.mkv", directory );
+    logNotice( "%s", path );
+    if ( writeFile( path, &spec ) == 0 )
+        { record( kKindHuge, path ); }
+}
+
+int main( int argc, char *argv[] )
+{
+    const char *directory;
+    char        path[1024];
+    int         opt;
+
+    gExecName = strrchr(argv[0], '/');
+    if (gExecName == NULL)
+        { gExecName = argv[0]; }
+    else
+        { ++gExecName; }
+
+    initLogging( gExecName );
+    startLogging( kLogNotice, NULL );
+
+    while ( (opt = getopt( argc, argv, "s:H:" )) != -1 )
+    {
+        switch ( opt )
+        {
+        case 's': scale  = atof( optarg ); break;
+        case 'H': hugeMB = atoi( optarg ); break;
+        default:
+            fprintf( stderr, "usage: %s [-s <scale>] [-H <MB>] <directory>\n", gExecName );
+            return 1;
+        }
+    }
+    if ( optind != argc - 1 )
+    {
+        fprintf( stderr, "usage: %s [-s <scale>] [-H <MB>] <directory>\n", gExecName );
+        return 1;
+    }
+    directory = argv[optind];
+
+    if ( mkdir( directory, 0755 ) != 0 && errno != EEXIST )
+    {
+        logError( "unable to create \"%s\" (%d: %s)", directory, errno, strerror( errno ) );
+        return 1;
+    }
+
+    snprintf( path, sizeof( path ), "%s/MANIFEST.tsv", directory );
+    manifest = fopen( path, "w" );
+    if ( manifest == NULL )
+    {
+        logError( "unable to create \"%s\" (%d: %s)", path, errno, strerror( errno ) );
+        return 1;
+    }
+
+    /* the muxers are chatty about the odd combinations we ask for */
+    av_log_set_level( AV_LOG_ERROR );
+
+    makeNormal( directory );
+    makeTiny( directory );
+    makeHuge( directory );
+
+    fclose( manifest );
+    stopLogging();
+
+    return 0;
+}
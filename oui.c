@@ -0,0 +1,637 @@
+/*
+    The compact OUI database.
+
+    The dense database (see mapDatabase()) gives every one of the 2^24
+    possible OUIs a slot, 32 MB of them, when only a few tens of thousands
+    are assigned - so a lookup for a random MAC touches a fresh page nearly
+    every time, and the whole table is read in before it's warm. This one
+    keeps just the assigned OUIs, sorted, in Eytzinger order: the first few
+    levels of the search tree share a couple of cache lines, every lookup
+    walks down the same way, and the next levels can be prefetched while
+    the current one is compared. A 35,000 OUI registry is about 300 KB of
+    keys and offsets, plus its names.
+
+    Company names are interned: one copy of each in the pool, however many
+    OUIs it has (some have hundreds), and a lookup returns a pointer into
+    the mapping rather than a copy. The file is mapped read-only and
+    private, so nothing is reserved or written back, and a reader can never
+    scribble on it.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "logging.h"
+#include "oui.h"
+
+#define _align( x )     (((x) + 63) & ~(uint64_t)63)
+
+void ouiLayout( const tOUIHeader *header, tOUILayout *layout )
+{
+    layout->keys  = _align( sizeof( tOUIHeader ) );
+    layout->names = layout->keys  + _align( ((uint64_t)header->count + 1) * sizeof( uint32_t ) );
+    layout->pool  = layout->names + _align( ((uint64_t)header->count + 1) * sizeof( uint32_t ) );
+    layout->size  = layout->pool  + header->poolSize;
+}
+
+tOUIDatabase *ouiOpen( const char *path )
+{
+    tOUIDatabase       *db;
+    const tOUIHeader   *header;
+    tOUILayout          layout;
+    struct stat         st;
+    void               *memory;
+    int                 fd;
+
+    fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd == -1 || fstat( fd, &st ) != 0 )
+    {
+        logError( "unable to open the OUI database \"%s\" (%d: %s)", path, errno, strerror( errno ) );
+        if ( fd != -1 )
+            { close( fd ); }
+        return NULL;
+    }
+    if ( (size_t)st.st_size < sizeof( tOUIHeader ) )
+    {
+        logError( "\"%s\" is not an OUI database", path );
+        close( fd );
+        return NULL;
+    }
+    memory = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( memory == MAP_FAILED )
+    {
+        logError( "unable to map the OUI database \"%s\" (%d: %s)", path, errno, strerror( errno ) );
+        return NULL;
+    }
+
+    header = memory;
+    ouiLayout( header, &layout );
+    if ( memcmp( header->magic, kOUIMagic, sizeof( header->magic ) ) != 0
+      || header->version != kOUIVersion
+      || layout.size > (uint64_t)st.st_size
+      || (header->poolSize > 0 && ((const char *)memory)[layout.pool + header->poolSize - 1] != '\0') )
+    {
+        logError( "\"%s\" is not an OUI database (or is from a different version)", path );
+        munmap( memory, st.st_size );
+        return NULL;
+    }
+
+    db = malloc( sizeof( tOUIDatabase ) );
+    if ( db == NULL )
+    {
+        logError( "out of memory" );
+        exit( __LINE__ );
+    }
+    db->map      = memory;
+    db->size     = st.st_size;
+    db->count    = header->count;
+    db->keys     = (const uint32_t *)((const char *)memory + layout.keys);
+    db->names    = (const uint32_t *)((const char *)memory + layout.names);
+    db->pool     = (const char *)memory + layout.pool;
+    db->poolSize = header->poolSize;
+
+    return db;
+}
+
+void ouiClose( tOUIDatabase *db )
+{
+    if ( db != NULL )
+    {
+        munmap( db->map, db->size );
+        free( db );
+    }
+}
+
+const char *ouiLookup( const tOUIDatabase *db, tMACaddr mac )
+{
+    uint32_t    key = (mac >> 24) & 0xFFFFFF;
+    uint32_t    k = 1;
+
+    while ( k <= db->count )
+    {
+        /* the 16 descendants four levels down share one cache line */
+        __builtin_prefetch( db->keys + 16 * (uint64_t)k );
+        k = 2 * k + (db->keys[k] < key);
+    }
+    /* undo the right turns after the last left one, which is where the
+       search went past the first key >= the one we want */
+    k >>= __builtin_ffs( ~k );
+
+    if ( k != 0 && db->keys[k] == key && db->names[k] < db->poolSize )
+    {
+        return db->pool + db->names[k];
+    }
+    return NULL;
+}
+
+/*
+ * batches
+ */
+
+#define kParseBlock     64      /* MACs converted at once */
+#define kLookupGroup    16      /* searches walked down the tree together */
+
+/* the slow way, for the forms without fixed separators: exactly 12 hex
+   digits, with any ':', '-' or '.' between them */
+static tMACaddr _parseLoose( const char *text, int length )
+{
+    tMACaddr    mac = 0;
+    int         digits = 0;
+    int         c;
+
+    for ( int i = 0; i < length; ++i )
+    {
+        c = tolower( (unsigned char)text[i] );
+        if ( c >= '0' && c <= '9' )
+            { mac = (mac << 4) | (c - '0'); }
+        else if ( c >= 'a' && c <= 'f' )
+            { mac = (mac << 4) | (c - 'a' + 10); }
+        else if ( c == ':' || c == '-' || c == '.' )
+            { continue; }
+        else
+            { return kMACInvalid; }
+        if ( ++digits > 12 )
+            { return kMACInvalid; }
+    }
+    return (digits == 12) ? mac : kMACInvalid;
+}
+
+/*
+    Nearly every MAC in a log is aa:bb:cc:dd:ee:ff (or with dashes), so a
+    block of those has its 12 digits gathered into one flat array and
+    converted together: a plain loop over contiguous bytes with no
+    branches, which the compiler vectorizes (see the Makefile) - 16 or 32
+    digits per instruction, rather than a compare-and-branch for each one.
+*/
+size_t ouiParseMACs( const char * const texts[], const int lengths[], size_t count, tMACaddr macs[] )
+{
+    uint8_t         digits[kParseBlock * 12];
+    uint8_t         good[kParseBlock * 12];
+    uint8_t         fast[kParseBlock];
+    const char     *t;
+    size_t          parsed = 0, n;
+    int             length;
+    uint8_t         c, lower, isDigit, isHex;
+    tMACaddr        mac;
+    int             ok;
+
+    for ( size_t first = 0; first < count; first += n )
+    {
+        n = (count - first < kParseBlock) ? count - first : kParseBlock;
+
+        /* gather */
+        for ( size_t j = 0; j < n; ++j )
+        {
+            t = texts[first + j];
+            length = (lengths != NULL) ? lengths[first + j] : (int)strnlen( t, 32 );
+            fast[j] = (length == 17 && (t[2] == ':' || t[2] == '-')
+                    && t[5] == t[2] && t[8] == t[2] && t[11] == t[2] && t[14] == t[2]);
+            if ( fast[j] )
+            {
+                for ( int d = 0; d < 6; ++d )
+                {
+                    digits[j * 12 + 2 * d]     = t[3 * d];
+                    digits[j * 12 + 2 * d + 1] = t[3 * d + 1];
+                }
+            }
+            else
+            {
+                memset( &digits[j * 12], '0', 12 );
+            }
+        }
+
+        /* convert */
+        for ( size_t i = 0; i < n * 12; ++i )
+        {
+            c       = digits[i];
+            lower   = c | 0x20;
+            isDigit = (uint8_t)(c - '0') < 10;
+            isHex   = (uint8_t)(lower - 'a') < 6;
+            digits[i] = isDigit ? (uint8_t)(c - '0') : (uint8_t)(lower - 'a' + 10);
+            good[i]   = isDigit | isHex;
+        }
+
+        /* assemble */
+        for ( size_t j = 0; j < n; ++j )
+        {
+            if ( !fast[j] )
+            {
+                t = texts[first + j];
+                length = (lengths != NULL) ? lengths[first + j] : (int)strnlen( t, 32 );
+                macs[first + j] = _parseLoose( t, length );
+            }
+            else
+            {
+                mac = 0;
+                ok  = 1;
+                for ( int d = 0; d < 12; ++d )
+                {
+                    mac = (mac << 4) | digits[j * 12 + d];
+                    ok &= good[j * 12 + d];
+                }
+                macs[first + j] = ok ? mac : kMACInvalid;
+            }
+            parsed += (macs[first + j] != kMACInvalid);
+        }
+    }
+
+    return parsed;
+}
+
+/*
+    The searches in a group are walked down the tree a level at a time,
+    together, so the CPU has a group's worth of independent loads in flight
+    rather than one chain of dependent ones. Every search takes the same
+    number of steps - the levels above the last are full - and the group
+    size is fixed, so the compiler keeps it all in registers. A part group
+    at the end is looked up one at a time.
+*/
+void ouiLookupBatch( const tOUIDatabase *db, const tMACaddr macs[], size_t count, const char *names[] )
+{
+    uint32_t    key[kLookupGroup], k[kLookupGroup];
+    uint32_t    levels;
+    size_t      first = 0;
+
+    levels = (db->count > 0) ? 32 - __builtin_clz( db->count ) : 0;
+
+    for ( ; levels > 0 && first + kLookupGroup <= count; first += kLookupGroup )
+    {
+        for ( int j = 0; j < kLookupGroup; ++j )
+        {
+            key[j] = (macs[first + j] >> 24) & 0xFFFFFF;
+            k[j]   = 1;
+        }
+        for ( uint32_t level = 1; level < levels; ++level )
+        {
+            for ( int j = 0; j < kLookupGroup; ++j )
+            {
+                k[j] = 2 * k[j] + (db->keys[k[j]] < key[j]);
+            }
+        }
+        for ( int j = 0; j < kLookupGroup; ++j )
+        {
+            /* the last level may be partly filled */
+            if ( k[j] <= db->count )
+                { k[j] = 2 * k[j] + (db->keys[k[j]] < key[j]); }
+            k[j] >>= __builtin_ffs( ~k[j] );
+
+            names[first + j] = (k[j] != 0 && db->keys[k[j]] == key[j] && db->names[k[j]] < db->poolSize)
+                             ? db->pool + db->names[k[j]] : NULL;
+        }
+    }
+    for ( ; first < count; ++first )
+    {
+        names[first] = ouiLookup( db, macs[first] );
+    }
+}
+
+/*
+ * writing
+ */
+
+typedef struct {
+    uint32_t        oui;
+    const char     *name;
+    uint32_t        offset;         /* of the name in the pool */
+} tOUIEntry;
+
+/* by OUI, then in the order they were given (qsort() isn't stable) */
+static int _byOUI( const void *a, const void *b )
+{
+    const tOUIEntry *x = *(tOUIEntry * const *)a, *y = *(tOUIEntry * const *)b;
+
+    if ( x->oui != y->oui )
+    {
+        return (x->oui > y->oui) - (x->oui < y->oui);
+    }
+    return (x > y) - (x < y);
+}
+
+static int _byName( const void *a, const void *b )
+{
+    return strcmp( (*(tOUIEntry * const *)a)->name, (*(tOUIEntry * const *)b)->name );
+}
+
+/* an in-order walk of the tree puts the sorted entries in Eytzinger order */
+static uint32_t _eytzinger( tOUIEntry * const sorted[], uint32_t i, uint32_t k, uint32_t count,
+                            uint32_t keys[], uint32_t names[] )
+{
+    if ( k <= count )
+    {
+        i = _eytzinger( sorted, i, 2 * k, count, keys, names );
+        keys[k]  = sorted[i]->oui;
+        names[k] = sorted[i]->offset;
+        ++i;
+        i = _eytzinger( sorted, i, 2 * k + 1, count, keys, names );
+    }
+    return i;
+}
+
+int ouiWrite( const char *path, const uint32_t ouis[], const char * const names[], uint32_t count )
+{
+    tOUIEntry      *entries;
+    tOUIEntry     **order;
+    tOUIHeader      header;
+    tOUILayout      layout;
+    char           *image, *pool;
+    char            temporary[1024];
+    uint32_t        unique, nameCount, poolSize, length;
+    ssize_t         written;
+    int             fd, result = 0;
+
+    entries = calloc( count + 1, sizeof( tOUIEntry ) );
+    order   = calloc( count + 1, sizeof( tOUIEntry * ) );
+    if ( entries == NULL || order == NULL )
+    {
+        logError( "out of memory" );
+        exit( __LINE__ );
+    }
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+        entries[i].oui  = ouis[i] & 0xFFFFFF;
+        entries[i].name = names[i];
+        order[i] = &entries[i];
+    }
+
+    /* one name for each OUI - the first one wins */
+    qsort( order, count, sizeof( tOUIEntry * ), _byOUI );
+    unique = 0;
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+        if ( unique > 0 && order[i]->oui == order[unique - 1]->oui )
+        {
+            logDebug( "%06x is in the registry more than once", order[i]->oui );
+            continue;
+        }
+        order[unique++] = order[i];
+    }
+    if ( unique != count )
+    {
+        logWarning( "%u OUIs were in the registry more than once, the first name was kept", count - unique );
+    }
+
+    /* one copy of each name that's left */
+    qsort( order, unique, sizeof( tOUIEntry * ), _byName );
+    poolSize  = 0;
+    nameCount = 0;
+    for ( uint32_t i = 0; i < unique; ++i )
+    {
+        if ( i > 0 && strcmp( order[i]->name, order[i - 1]->name ) == 0 )
+        {
+            order[i]->offset = order[i - 1]->offset;
+            continue;
+        }
+        order[i]->offset = poolSize;
+        poolSize += strlen( order[i]->name ) + 1;
+        ++nameCount;
+    }
+    qsort( order, unique, sizeof( tOUIEntry * ), _byOUI );
+
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, kOUIMagic, sizeof( header.magic ) );
+    header.version   = kOUIVersion;
+    header.count     = unique;
+    header.nameCount = nameCount;
+    header.poolSize  = poolSize;
+    ouiLayout( &header, &layout );
+
+    image = calloc( 1, layout.size );
+    if ( image == NULL )
+    {
+        logError( "out of memory" );
+        exit( __LINE__ );
+    }
+    _eytzinger( order, 0, 1, unique, (uint32_t *)(image + layout.keys), (uint32_t *)(image + layout.names) );
+
+    /* the pool, in the order the names were given their offsets */
+    pool = image + layout.pool;
+    for ( uint32_t i = 0; i < unique; ++i )
+    {
+        length = strlen( order[i]->name ) + 1;
+        memcpy( pool + order[i]->offset, order[i]->name, length );
+    }
+    memcpy( image, &header, sizeof( tOUIHeader ) );
+
+    /* written alongside, and renamed into place, so a reader never sees half a database */
+    snprintf( temporary, sizeof( temporary ), "%s.%d", path, (int)getpid() );
+    fd = open( temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if ( fd == -1 )
+    {
+        logError( "unable to create \"%s\" (%d: %s)", temporary, errno, strerror( errno ) );
+        result = -1;
+    }
+    else
+    {
+        written = write( fd, image, layout.size );
+        if ( written != (ssize_t)layout.size )
+        {
+            logError( "unable to write \"%s\" (%d: %s)", temporary, errno, strerror( errno ) );
+            result = -1;
+        }
+        if ( close( fd ) != 0 || result != 0 || rename( temporary, path ) != 0 )
+        {
+            unlink( temporary );
+            result = -1;
+        }
+        else
+        {
+            logInfo( "wrote %u OUIs (%u companies) to \"%s\", %llu bytes",
+                     unique, nameCount, path, (unsigned long long)layout.size );
+        }
+    }
+
+    free( image );
+    free( order );
+    free( entries );
+
+    return result;
+}
+
+int ouiCompactDense( const char *path )
+{
+    static char    *names[UINT16_MAX + 1];     /* assembled once per company */
+    uint32_t       *ouis;
+    const char    **ouiNames;
+    uint32_t        count = 0, allocated = 0;
+    tCompanyIndex   company;
+    int             result;
+
+    if ( access( "oui.db", R_OK ) != 0 )
+    {
+        logError( "there's no dense database (oui.db) to convert" );
+        return -1;
+    }
+    mapDatabase();
+
+    ouis     = NULL;
+    ouiNames = NULL;
+    for ( uint32_t oui = 0; oui <= 0xFFFFFF; ++oui )
+    {
+        company = gMACtoCompany[oui];
+        if ( gCompaniesLen[company] == 0 )
+        {
+            /* not assigned */
+            continue;
+        }
+        if ( names[company] == NULL )
+        {
+            names[company] = assembleCompany( company );
+            if ( names[company] == NULL )
+            {
+                logError( "out of memory" );
+                exit( __LINE__ );
+            }
+        }
+        if ( count == allocated )
+        {
+            allocated = (allocated == 0) ? 16384 : allocated * 2;
+            ouis      = realloc( ouis, allocated * sizeof( uint32_t ) );
+            ouiNames  = realloc( ouiNames, allocated * sizeof( char * ) );
+            if ( ouis == NULL || ouiNames == NULL )
+            {
+                logError( "out of memory" );
+                exit( __LINE__ );
+            }
+        }
+        ouis[count]     = oui;
+        ouiNames[count] = names[company];
+        ++count;
+    }
+
+    result = ouiWrite( path, ouis, ouiNames, count );
+
+    for ( uint32_t c = 0; c <= UINT16_MAX; ++c )
+    {
+        free( names[c] );
+        names[c] = NULL;
+    }
+    free( ouiNames );
+    free( ouis );
+    unmapDatabase();
+
+    return result;
+}
+
+/*
+ * importing
+ */
+
+/* "00-22-72   (hex)\t\tAmerican Micro-Fuel Device Corp." - the other lines
+   of an entry (base 16, the address) are skipped */
+static int _registryLine( char *line, uint32_t *oui, char **name )
+{
+    char   *p = line, *end;
+    char    digits[7];
+
+    while ( *p == ' ' || *p == '\t' )
+        { ++p; }
+    for ( int i = 0; i < 8; ++i )
+    {
+        if ( (i % 3 == 2) ? (p[i] != '-') : !isxdigit( (unsigned char)p[i] ) )
+            { return 0; }
+    }
+    snprintf( digits, sizeof( digits ), "%.2s%.2s%.2s", p, p + 3, p + 6 );
+    *oui = strtoul( digits, NULL, 16 );
+
+    p += 8;
+    while ( *p == ' ' || *p == '\t' )
+        { ++p; }
+    if ( strncmp( p, "(hex)", 5 ) != 0 )
+        { return 0; }
+    p += 5;
+    while ( *p == ' ' || *p == '\t' )
+        { ++p; }
+
+    end = p + strlen( p );
+    while ( end > p && isspace( (unsigned char)end[-1] ) )
+        { --end; }
+    *end = '\0';
+    *name = p;
+
+    return 1;
+}
+
+int ouiImport( const char *registry, const char *path )
+{
+    FILE           *input;
+    char           *line = NULL;
+    size_t          size = 0;
+    uint32_t       *ouis = NULL;
+    char          **names = NULL;
+    uint32_t        count = 0, allocated = 0, oui;
+    char           *name;
+    int             result;
+
+    input = (strcmp( registry, "-" ) == 0) ? stdin : fopen( registry, "r" );
+    if ( input == NULL )
+    {
+        logError( "unable to open \"%s\" (%d: %s)", registry, errno, strerror( errno ) );
+        return -1;
+    }
+
+    while ( getline( &line, &size, input ) > 0 )
+    {
+        if ( !_registryLine( line, &oui, &name ) )
+        {
+            continue;
+        }
+        if ( count == allocated )
+        {
+            allocated = (allocated == 0) ? 65536 : allocated * 2;
+            ouis  = realloc( ouis, allocated * sizeof( uint32_t ) );
+            names = realloc( names, allocated * sizeof( char * ) );
+            if ( ouis == NULL || names == NULL )
+            {
+                logError( "out of memory" );
+                exit( __LINE__ );
+            }
+        }
+        ouis[count]  = oui;
+        names[count] = strdup( name );
+        if ( names[count] == NULL )
+        {
+            logError( "out of memory" );
+            exit( __LINE__ );
+        }
+        ++count;
+    }
+    result = ferror( input ) ? -1 : 0;
+    if ( input != stdin )
+    {
+        fclose( input );
+    }
+    free( line );
+
+    if ( result != 0 )
+    {
+        logError( "unable to read \"%s\"", registry );
+    }
+    else if ( count == 0 )
+    {
+        logError( "no OUIs in \"%s\" - is it the IEEE registry text (oui.txt)?", registry );
+        result = -1;
+    }
+    else
+    {
+        result = ouiWrite( path, ouis, (const char * const *)names, count );
+    }
+
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+        free( names[i] );
+    }
+    free( names );
+    free( ouis );
+
+    return result;
+}
@@ -0,0 +1,86 @@
+/*
+    the compact OUI database: only the assigned OUIs, read-only
+*/
+
+#ifndef OUI_H
+#define OUI_H
+
+#include <stdint.h>
+
+#include "common.h"
+
+#define kOUIMagic       "FFTOUI01"
+#define kOUIVersion     1
+#define kOUIDefaultPath "oui.idx"
+
+/*
+    A header, then the keys (the 24 bit OUIs) in Eytzinger order - the
+    implicit binary search tree, root at 1, children of k at 2k and 2k + 1 -
+    then, in the same order, the offset of each one's company name in the
+    pool, then the pool of NUL terminated names, each stored once. Slot 0
+    of the keys and names is unused. The keys and names start on a cache
+    line; the offsets follow from the counts (see ouiLayout()).
+*/
+typedef struct {
+    char            magic[8];       /* kOUIMagic */
+    uint32_t        version;        /* kOUIVersion */
+    uint32_t        count;          /* OUIs */
+    uint32_t        nameCount;      /* distinct company names */
+    uint32_t        poolSize;       /* bytes */
+} tOUIHeader;
+
+typedef struct {
+    uint64_t        keys;
+    uint64_t        names;
+    uint64_t        pool;
+    uint64_t        size;           /* of the whole file */
+} tOUILayout;
+
+void            ouiLayout( const tOUIHeader *header, tOUILayout *layout );
+
+typedef struct {
+    void               *map;
+    uint64_t            size;
+    uint32_t            count;
+    const uint32_t     *keys;
+    const uint32_t     *names;
+    const char         *pool;
+    uint32_t            poolSize;
+} tOUIDatabase;
+
+/* map a compact database, read-only. Returns NULL on failure */
+tOUIDatabase *  ouiOpen( const char *path );
+void            ouiClose( tOUIDatabase *db );
+
+/* the company a MAC address (or an OUI << 24) was assigned to, pointing
+   into the database, or NULL if it's not assigned */
+const char *    ouiLookup( const tOUIDatabase *db, tMACaddr mac );
+
+/*
+    batches, for annotating logs: many MACs at a time, with nothing
+    allocated per address
+*/
+#define kMACInvalid     (~(tMACaddr)0)      /* not a MAC, from ouiParseMACs() */
+
+/* parse 'count' MAC addresses (aa:bb:cc:dd:ee:ff, aa-bb-..., aabb.ccdd.eeff
+   or aabbccddeeff, in either case) of lengths[i] chars (or NUL terminated,
+   if lengths is NULL) into macs[], kMACInvalid for any that isn't one.
+   Returns the number that were */
+size_t          ouiParseMACs( const char * const texts[], const int lengths[], size_t count, tMACaddr macs[] );
+
+/* look up 'count' MAC addresses, setting names[i] as ouiLookup() would.
+   The names point into the database, valid until ouiClose() */
+void            ouiLookupBatch( const tOUIDatabase *db, const tMACaddr macs[], size_t count, const char *names[] );
+
+/* read the IEEE MA-L registry text (oui.txt, "-" for stdin) and write it
+   as a compact database. Returns 0 on success */
+int             ouiImport( const char *registry, const char *path );
+
+/* write a compact database of 'count' OUIs and their company names, in
+   any order. Returns 0 on success */
+int             ouiWrite( const char *path, const uint32_t ouis[], const char * const names[], uint32_t count );
+
+/* convert the dense database (see mapDatabase()) into a compact one at 'path' */
+int             ouiCompactDense( const char *path );
+
+#endif
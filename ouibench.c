@@ -0,0 +1,405 @@
+/*
+    Benchmark: OUI lookups, the dense database (mapDatabase()) against the
+    compact one (oui.c).
+
+    Builds a synthetic registry the size of the real one in a scratch
+    directory - random OUIs, company names of one to four words, a few
+    companies with many OUIs - writes it in the dense layout, converts it
+    with ouiCompactDense(), and checks that every OUI gets the same name
+    from both. Then, for each: the cold start (open and map with the file
+    out of the page cache, and the first thousand lookups), lookups/sec for
+    random MACs, and how much of the mapping is resident afterwards.
+
+    Then the batch path for annotating logs: the registry written out as
+    IEEE oui.txt and read back with ouiImport(), MAC strings parsed one at
+    a time with parseMAC() against ouiParseMACs(), and ouiLookup() against
+    ouiLookupBatch(), checking each gives the same answers.
+
+    usage: ouibench [lookups [ouis]]
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "logging.h"
+#include "oui.h"
+
+#define kWords          2000
+#define kColdLookups    1000
+#define kBatch          1024    /* MACs per ouiParseMACs() / ouiLookupBatch() call */
+
+/* keeps the optimizer from deleting the loops */
+volatile uint64_t gSink;
+
+static uint64_t gRandom = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t randomNumber( void )
+{
+    /* xorshift64* - deterministic, so every run measures the same registry */
+    gRandom ^= gRandom >> 12;
+    gRandom ^= gRandom << 25;
+    gRandom ^= gRandom >> 27;
+    return (gRandom * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+static double elapsed( const struct timespec *start )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* the dense lookup, as a caller of the old layout does it */
+static char *denseLookup( tMACaddr mac )
+{
+    tCompanyIndex company = gMACtoCompany[(mac >> 24) & 0xFFFFFF];
+
+    return (gCompaniesLen[company] != 0) ? assembleCompany( company ) : NULL;
+}
+
+static size_t resident( const void *address, size_t length )
+{
+    long            page = sysconf( _SC_PAGESIZE );
+    size_t          pages = (length + page - 1) / page, count = 0;
+    unsigned char  *vector = malloc( pages );
+
+    if ( vector != NULL && mincore( (void *)address, length, vector ) == 0 )
+    {
+        for ( size_t i = 0; i < pages; ++i )
+            { count += vector[i] & 1; }
+    }
+    free( vector );
+    return count * page;
+}
+
+static void dropCache( const char *path )
+{
+    int fd = open( path, O_RDONLY );
+
+    if ( fd != -1 )
+    {
+        fdatasync( fd );
+        posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+        close( fd );
+    }
+}
+
+/* the synthetic registry, in the dense layout */
+static uint32_t buildDense( uint32_t count, uint32_t **ouis )
+{
+    static char     words[kWords][16];
+    uint16_t        wordBucket[kWords];
+    uint32_t        bucket = 1, slot = 1, companies, company, length, unique;
+    tCompanyIndex  *companyIndex;
+    uint8_t        *taken;
+
+    /* words of 2 to 12 letters, each stored once in the buckets */
+    for ( int w = 0; w < kWords; ++w )
+    {
+        length = 2 + randomNumber() % 11;
+        for ( uint32_t c = 0; c < length; ++c )
+            { words[w][c] = (c == 0 ? 'A' : 'a') + randomNumber() % 26; }
+        words[w][length] = '\0';
+        wordBucket[w] = bucket;
+        strcpy( (char *)&gBuckets[bucket], words[w] );
+        bucket += (length + 1 + sizeof( tBucket ) - 1) / sizeof( tBucket );
+    }
+
+    /* companies of one to four words; company 0 is left empty, for "unassigned" */
+    companies    = count / 3;
+    companyIndex = malloc( companies * sizeof( tCompanyIndex ) );
+    for ( uint32_t c = 0; c < companies; ++c )
+    {
+        length = 1 + randomNumber() % 4;
+        companyIndex[c]     = slot;
+        gCompaniesLen[slot] = length;
+        for ( uint32_t w = 0; w < length; ++w )
+            { gCompanies[slot++] = wordBucket[randomNumber() % kWords]; }
+    }
+
+    /* distinct OUIs; a quarter go to a few big companies */
+    taken = calloc( 1 << 24, 1 );
+    *ouis = malloc( count * sizeof( uint32_t ) );
+    unique = 0;
+    while ( unique < count )
+    {
+        uint32_t oui = randomNumber() & 0xFFFFFF;
+
+        if ( taken[oui] )
+            { continue; }
+        taken[oui] = 1;
+        company = (randomNumber() % 4 == 0) ? randomNumber() % 32 : randomNumber() % companies;
+        gMACtoCompany[oui] = companyIndex[company];
+        (*ouis)[unique++] = oui;
+    }
+    free( taken );
+    free( companyIndex );
+
+    return unique;
+}
+
+/* the registry as the IEEE publishes it */
+static void writeRegistry( const char *path, const uint32_t ouis[], uint32_t count )
+{
+    FILE   *file = fopen( path, "w" );
+    char    name[256];
+
+    fprintf( file, "OUI/MA-L\t\t\tOrganization\ncompany_id\t\t\tOrganization\n\t\t\t\tAddress\n\n" );
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+        assembleCompanyInto( gMACtoCompany[ouis[i]], name, sizeof( name ) );
+        fprintf( file, "%02X-%02X-%02X   (hex)\t\t%s\r\n", ouis[i] >> 16, (ouis[i] >> 8) & 0xFF, ouis[i] & 0xFF, name );
+        fprintf( file, "%06X     (base 16)\t\t%s\r\n", ouis[i], name );
+        fprintf( file, "\t\t\t\t1 Some Street\r\n\t\t\t\tSomewhere  CA  90000\r\n\t\t\t\tUS\r\n\r\n" );
+    }
+    fclose( file );
+}
+
+int main( int argc, char *argv[] )
+{
+    uint64_t        lookups = (argc > 1) ? strtoull( argv[1], NULL, 10 ) : 10000000;
+    uint32_t        count   = (argc > 2) ? strtoul( argv[2], NULL, 10 ) : 35000;
+    char            directory[] = "/tmp/ouibench.XXXXXX";
+    uint32_t       *ouis;
+    tMACaddr       *macs;
+    tOUIDatabase   *db;
+    struct timespec start;
+    double          denseCold, compactCold, dense, denseIndex, compact, compactCopy;
+    double          import, parseOne, parseBatch, lookupBatch;
+    tOUIDatabase   *imported;
+    char           *texts;
+    const char    **textPointers;
+    tMACaddr       *parsed;
+    const char    **names;
+    size_t          denseResident, compactResident;
+    uint64_t        sum = 0, mismatches = 0;
+    const char     *name;
+    char           *copy;
+
+    initLogging( "ouibench" );
+    startLogging( kLogNotice, NULL );
+
+    if ( count == 0 || count > 60000 )
+    {
+        fprintf( stderr, "usage: %s [lookups [ouis (1..60000)]]\n", argv[0] );
+        return 1;
+    }
+    if ( mkdtemp( directory ) == NULL || chdir( directory ) != 0 )
+    {
+        fprintf( stderr, "unable to make a scratch directory (%d: %s)\n", errno, strerror( errno ) );
+        return 1;
+    }
+
+    mapDatabase();
+    count = buildDense( count, &ouis );
+    msync( gMACtoCompany, 1 << 25, MS_SYNC );
+    unmapDatabase();
+    if ( ouiCompactDense( kOUIDefaultPath ) != 0 )
+    {
+        return 1;
+    }
+
+    /* random MACs, nine in ten from an assigned OUI */
+    macs = malloc( lookups * sizeof( tMACaddr ) );
+    for ( uint64_t i = 0; i < lookups; ++i )
+    {
+        uint32_t oui = (randomNumber() % 10 != 0) ? ouis[randomNumber() % count] : (randomNumber() & 0xFFFFFF);
+
+        macs[i] = ((tMACaddr)oui << 24) | (randomNumber() & 0xFFFFFF);
+    }
+
+    /* cold starts */
+    dropCache( "oui.db" );
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    mapDatabase();
+    for ( int i = 0; i < kColdLookups; ++i )
+    {
+        copy = denseLookup( macs[i] );
+        sum += (copy != NULL) ? copy[0] : 0;
+        free( copy );
+    }
+    denseCold = elapsed( &start );
+
+    dropCache( kOUIDefaultPath );
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    db = ouiOpen( kOUIDefaultPath );
+    if ( db == NULL )
+    {
+        return 1;
+    }
+    for ( int i = 0; i < kColdLookups; ++i )
+    {
+        name = ouiLookup( db, macs[i] );
+        sum += (name != NULL) ? name[0] : 0;
+    }
+    compactCold = elapsed( &start );
+
+    /* both give the same answer for every assigned OUI, and a sample of the rest */
+    for ( uint32_t i = 0; i < count + 100000; ++i )
+    {
+        tMACaddr mac = (tMACaddr)((i < count) ? ouis[i] : (randomNumber() & 0xFFFFFF)) << 24;
+
+        copy = denseLookup( mac );
+        name = ouiLookup( db, mac );
+        if ( (copy == NULL) != (name == NULL) || (copy != NULL && strcmp( copy, name ) != 0) )
+        {
+            if ( mismatches++ < 5 )
+                { fprintf( stderr, "%06x: dense \"%s\", compact \"%s\"\n", (unsigned)(mac >> 24), copy ? copy : "(none)", name ? name : "(none)" ); }
+        }
+        free( copy );
+    }
+
+    /* throughput */
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    for ( uint64_t i = 0; i < lookups; ++i )
+    {
+        copy = denseLookup( macs[i] );
+        sum += (copy != NULL) ? copy[0] : 0;
+        free( copy );
+    }
+    dense = elapsed( &start );
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    for ( uint64_t i = 0; i < lookups; ++i )
+    {
+        sum += gMACtoCompany[(macs[i] >> 24) & 0xFFFFFF];
+    }
+    denseIndex = elapsed( &start );
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    for ( uint64_t i = 0; i < lookups; ++i )
+    {
+        name = ouiLookup( db, macs[i] );
+        sum += (name != NULL) ? name[0] : 0;
+    }
+    compact = elapsed( &start );
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    for ( uint64_t i = 0; i < lookups; ++i )
+    {
+        name = ouiLookup( db, macs[i] );
+        copy = (name != NULL) ? strdup( name ) : NULL;
+        sum += (copy != NULL) ? copy[0] : 0;
+        free( copy );
+    }
+    compactCopy = elapsed( &start );
+    gSink = sum;
+
+    /* the batch path */
+    texts        = malloc( lookups * kMACStringSize );
+    textPointers = malloc( lookups * sizeof( char * ) );
+    parsed       = malloc( lookups * sizeof( tMACaddr ) );
+    names        = malloc( lookups * sizeof( char * ) );
+    for ( uint64_t i = 0; i < lookups; ++i )
+    {
+        textPointers[i] = MACtoBuffer( macs[i], &texts[i * kMACStringSize] );
+        names[i]  = NULL;   /* so the page faults aren't timed */
+        parsed[i] = 0;
+    }
+
+    writeRegistry( "oui.txt", ouis, count );
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    if ( ouiImport( "oui.txt", "imported.idx" ) != 0 || (imported = ouiOpen( "imported.idx" )) == NULL )
+    {
+        return 1;
+    }
+    import = elapsed( &start );
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+        tMACaddr mac = (tMACaddr)ouis[i] << 24;
+
+        name = ouiLookup( imported, mac );
+        if ( name == NULL || strcmp( name, ouiLookup( db, mac ) ) != 0 )
+        {
+            if ( mismatches++ < 5 )
+                { fprintf( stderr, "%06x: imported \"%s\", converted \"%s\"\n", ouis[i], name ? name : "(none)", ouiLookup( db, mac ) ); }
+        }
+    }
+    ouiClose( imported );
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    for ( uint64_t i = 0; i < lookups; ++i )
+    {
+        parsed[i] = parseMAC( textPointers[i], kMACStringSize - 1 );
+    }
+    parseOne = elapsed( &start );
+    for ( uint64_t i = 0; i < lookups; ++i )
+    {
+        sum += parsed[i];
+        parsed[i] = 0;
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    for ( uint64_t i = 0; i < lookups; i += kBatch )
+    {
+        ouiParseMACs( &textPointers[i], NULL, (lookups - i < kBatch) ? lookups - i : kBatch, &parsed[i] );
+    }
+    parseBatch = elapsed( &start );
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    for ( uint64_t i = 0; i < lookups; i += kBatch )
+    {
+        ouiLookupBatch( db, &parsed[i], (lookups - i < kBatch) ? lookups - i : kBatch, &names[i] );
+    }
+    lookupBatch = elapsed( &start );
+
+    for ( uint64_t i = 0; i < lookups; ++i )
+    {
+        if ( parsed[i] != macs[i] || names[i] != ouiLookup( db, macs[i] ) )
+        {
+            if ( mismatches++ < 5 )
+                { fprintf( stderr, "%s: batch parsed %012llx, looked up \"%s\"\n", textPointers[i],
+                           (unsigned long long)parsed[i], names[i] ? names[i] : "(none)" ); }
+        }
+    }
+
+    denseResident   = resident( gMACtoCompany, 1 << 25 ) + resident( gBuckets, (UINT16_MAX + 1) * sizeof( tBucket ) )
+                    + resident( gCompanies, (UINT16_MAX + 1) * sizeof( uint16_t ) ) + resident( gCompaniesLen, UINT16_MAX + 1 );
+    compactResident = resident( db->map, db->size );
+
+    printf( "OUI lookups, %u assigned OUIs, %llu random MACs:\n", count, (unsigned long long)lookups );
+    printf( "  %-30s %10.1f ms\n",  "cold start, dense",   denseCold * 1e3 );
+    printf( "  %-30s %10.1f ms\n",  "cold start, compact", compactCold * 1e3 );
+    printf( "  %-30s %10.1f M/s\n", "dense, assembleCompany()",    lookups / dense / 1e6 );
+    printf( "  %-30s %10.1f M/s\n", "dense, company index only",   lookups / denseIndex / 1e6 );
+    printf( "  %-30s %10.1f M/s\n", "compact, ouiLookup()",        lookups / compact / 1e6 );
+    printf( "  %-30s %10.1f M/s\n", "compact, ouiLookup() + copy", lookups / compactCopy / 1e6 );
+    printf( "  %-30s %10.1f ms\n",  "import oui.txt",              import * 1e3 );
+    printf( "  %-30s %10.1f M/s\n", "parseMAC()",                  lookups / parseOne / 1e6 );
+    printf( "  %-30s %10.1f M/s\n", "ouiParseMACs()",              lookups / parseBatch / 1e6 );
+    printf( "  %-30s %10.1f M/s\n", "ouiLookupBatch()",            lookups / lookupBatch / 1e6 );
+    printf( "  %-30s %10zu KB of %zu KB\n", "resident, dense",   denseResident / 1024,
+            (size_t)((1 << 25) + (UINT16_MAX + 1) * 7) / 1024 );
+    printf( "  %-30s %10zu KB of %zu KB\n", "resident, compact", compactResident / 1024,
+            (size_t)((db->size + sysconf( _SC_PAGESIZE ) - 1) & ~(sysconf( _SC_PAGESIZE ) - 1)) / 1024 );
+    if ( mismatches != 0 )
+    {
+        printf( "  %llu OUIs gave different names!\n", (unsigned long long)mismatches );
+    }
+
+    ouiClose( db );
+    unmapDatabase();
+    free( names );
+    free( parsed );
+    free( textPointers );
+    free( texts );
+    free( macs );
+    free( ouis );
+    unlink( "oui.db" );
+    unlink( kOUIDefaultPath );
+    unlink( "oui.txt" );
+    unlink( "imported.idx" );
+    if ( chdir( "/" ) == 0 )
+        { rmdir( directory ); }
+
+    return (mismatches == 0) ? 0 : 1;
+}
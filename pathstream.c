@@ -0,0 +1,156 @@
+/*
+    Streaming path input.
+
+    The list is read in large chunks, and paths are handed out from the
+    buffer in place, so a list of millions costs a few hundred read()s and
+    no more memory than the buffer. Nothing is read until it's asked for:
+    when the caller stops asking, the pipe fills up and the producer (find,
+    say) blocks, which is the backpressure.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "common.h"
+#include "logging.h"
+#include "pathstream.h"
+
+#define kPathStreamBuffer   (1024 * 1024)
+
+struct tPathStream {
+    int             fd;
+    char            delimiter;
+    int             eof;
+    size_t          start;          /* the unread part of the buffer */
+    size_t          end;
+    unsigned long   skipped;        /* paths too long for the buffer */
+    int             discarding;     /* skipping the rest of one */
+    char            buffer[kPathStreamBuffer + 1];
+};
+
+tPathStream *pathStreamOpen( const char *from, char delimiter )
+{
+    tPathStream *stream;
+
+    stream = malloc( sizeof( tPathStream ) );
+    if ( stream == NULL )
+    {
+        logError( "out of memory" );
+        return NULL;
+    }
+    stream->delimiter = delimiter;
+    stream->eof       = 0;
+    stream->start     = 0;
+    stream->end       = 0;
+    stream->skipped   = 0;
+    stream->discarding = 0;
+
+    if ( strcmp( from, "-" ) == 0 )
+    {
+        stream->fd = STDIN_FILENO;
+    }
+    else
+    {
+        stream->fd = open( from, O_RDONLY | O_CLOEXEC );
+        if ( stream->fd == -1 )
+        {
+            logError( "unable to open \"%s\" (%d: %s)", from, errno, strerror( errno ) );
+            free( stream );
+            return NULL;
+        }
+    }
+
+    return stream;
+}
+
+int pathStreamBuffered( const tPathStream *stream )
+{
+    return memchr( &stream->buffer[stream->start], stream->delimiter, stream->end - stream->start ) != NULL;
+}
+
+int pathStreamNext( tPathStream *stream, const char **path )
+{
+    char       *found;
+    ssize_t     length;
+
+    for ( ;; )
+    {
+        found = memchr( &stream->buffer[stream->start], stream->delimiter, stream->end - stream->start );
+        if ( found != NULL )
+        {
+            *found = '\0';
+            *path = &stream->buffer[stream->start];
+            stream->start = found + 1 - stream->buffer;
+            if ( **path == '\0' || stream->discarding )
+            {
+                stream->discarding = 0;
+                continue;
+            }
+            return 1;
+        }
+
+        if ( stream->eof )
+        {
+            if ( stream->start < stream->end && !stream->discarding )
+            {
+                /* the last path, without a delimiter after it */
+                stream->buffer[stream->end] = '\0';
+                *path = &stream->buffer[stream->start];
+                stream->start = stream->end;
+                return 1;
+            }
+            if ( stream->skipped != 0 )
+            {
+                logWarning( "skipped %lu paths too long to be real", stream->skipped );
+            }
+            return 0;
+        }
+
+        /* keep the partial path, and fill up the rest */
+        if ( stream->start == 0 && stream->end == kPathStreamBuffer )
+        {
+            /* no delimiter in a whole buffer - drop it, and the rest of that path */
+            ++stream->skipped;
+            stream->discarding = 1;
+            stream->end = 0;
+        }
+        else
+        {
+            memmove( stream->buffer, &stream->buffer[stream->start], stream->end - stream->start );
+            stream->end  -= stream->start;
+            stream->start = 0;
+        }
+
+        length = read( stream->fd, &stream->buffer[stream->end], kPathStreamBuffer - stream->end );
+        if ( length < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+            logError( "unable to read the paths (%d: %s)", errno, strerror( errno ) );
+            return -1;
+        }
+        if ( length == 0 )
+        {
+            stream->eof = 1;
+        }
+        stream->end += length;
+    }
+}
+
+void pathStreamClose( tPathStream *stream )
+{
+    if ( stream != NULL )
+    {
+        if ( stream->fd != STDIN_FILENO )
+        {
+            close( stream->fd );
+        }
+        free( stream );
+    }
+}
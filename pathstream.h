@@ -0,0 +1,24 @@
+/*
+    reading a list of paths from a file or a pipe, as it arrives
+*/
+
+#ifndef PATHSTREAM_H
+#define PATHSTREAM_H
+
+typedef struct tPathStream tPathStream;
+
+/* read paths from 'from' ("-" for stdin), separated by 'delimiter' ('\n',
+   or '\0' for find -print0). Returns NULL on failure */
+tPathStream *   pathStreamOpen( const char *from, char delimiter );
+
+/* the next non-empty path, valid until the next call. Returns 1 for a
+   path, 0 at the end of the input, -1 on an error */
+int             pathStreamNext( tPathStream *stream, const char **path );
+
+/* non-zero if the next path is already buffered, i.e. pathStreamNext()
+   won't wait for the producer */
+int             pathStreamBuffered( const tPathStream *stream );
+
+void            pathStreamClose( tPathStream *stream );
+
+#endif
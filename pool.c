@@ -0,0 +1,601 @@
+/*
+    A pool of worker threads.
+
+    Items are handed out in order from a shared counter; a worker marks each
+    one done as it finishes, and poolWait() lets the caller consume them in
+    order (so the output doesn't depend on the timing). A stream of items
+    lives in a ring of 'capacity' slots: the producer adds them as they
+    arrive, and blocks in poolReserve() while the consumer hasn't released
+    the slots they'd reuse, so a fast producer can't run away with memory. Only the first
+    'active' workers take items, the rest wait, so the concurrency can be
+    changed at any time without stopping anything.
+
+    With --jobs auto, a controller thread adjusts 'active' every interval,
+    AIMD-style. It starts at one worker per core. As long as adding workers
+    keeps improving throughput it adds more - doubling at first, like TCP's
+    slow start, since a cold NAS scan keeps improving up to hundreds of
+    outstanding reads - and when they don't help it takes them back. If
+    the p90 time per item or the CPU load goes over its ceiling, it halves
+    them. After a few intervals without a change it tries a few more, since
+    the best count moves as the scan does. Each decision is logged through
+    the 'pool' scope.
+
+    poolSetOptions() changes the count, or the ceilings, of a running pool
+    (e.g. on a configuration reload); a worker finishes the file it's on
+    before it's parked.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "logging.h"
+#include "stats.h"
+#include "pool.h"
+
+#define kPoolInterval       500     /* ms between the controller's decisions */
+#define kPoolIncrease       4       /* workers added when growing */
+#define kPoolSamples        4096    /* per-item times kept per interval */
+#define kPoolProbe          4       /* intervals without a change before trying more workers */
+#define kPoolIdle           250     /* ms between the consumer's idle calls, while it waits */
+
+typedef struct {
+    uint64_t        busy;           /* user, nice, system, irq, softirq & steal jiffies */
+    uint64_t        iowait;
+    uint64_t        total;
+} tCpuTimes;
+
+static struct {
+    tPoolWorkFn         workFn;
+    void               *context;
+    unsigned int        capacity;       /* slots in the ring */
+    tPoolOptions        options;
+
+    unsigned int        next;           /* the next item to hand out */
+    unsigned int        added;          /* items added so far */
+    unsigned int        released;       /* items the consumer is finished with */
+    int                 ended;          /* no more items will be added */
+    uint8_t            *done;           /* per slot */
+    uint16_t           *doneBy;
+
+    pthread_mutex_t     lock;
+    pthread_cond_t      doneCond;       /* an item has been done or added, or the items have ended */
+    pthread_cond_t      releasedCond;   /* slots have been released */
+    pthread_cond_t      activeCond;     /* 'active' has changed, or we're stopping */
+    unsigned int        active;         /* workers allowed to take items */
+    unsigned int        created;
+    int                 stopping;
+    pthread_t           workers[kPoolMaxWorkers];
+
+    pthread_t           controller;
+    int                 controlled;
+
+    void              (*idle)( void );  /* see poolOnIdle() */
+
+    /* the controller's measurements, reset every interval */
+    uint64_t            items;
+    unsigned int        sampleCount;
+    uint64_t            samples[kPoolSamples];
+} gPool = {
+    .lock       = PTHREAD_MUTEX_INITIALIZER,
+    .doneCond   = PTHREAD_COND_INITIALIZER,
+    .releasedCond = PTHREAD_COND_INITIALIZER,
+    .activeCond = PTHREAD_COND_INITIALIZER
+};
+
+int parsePoolJobs( const char *text, unsigned int *jobs )
+{
+    char           *end;
+    unsigned long   count;
+
+    if ( strcmp( text, "auto" ) == 0 )
+    {
+        *jobs = 0;
+        return 0;
+    }
+    count = strtoul( text, &end, 10 );
+    if ( end == text || *end != '\0' || count < 1 || count > kPoolMaxWorkers )
+    {
+        logError( "\"%s\" isn't a job count - expected 1 to %d, or auto", text, kPoolMaxWorkers );
+        return -1;
+    }
+    *jobs = count;
+    return 0;
+}
+
+static void *_worker( void *arg )
+{
+    unsigned int    worker = (uintptr_t)arg;
+    unsigned int    index, sample;
+    uint64_t        start;
+    int             flushed = 0;
+
+    for ( ;; )
+    {
+        pthread_mutex_lock( &gPool.lock );
+        while ( !gPool.stopping
+             && (worker >= gPool.active || (gPool.next >= gPool.added && !gPool.ended)) )
+        {
+            /* parked (by the controller, or for want of items) for who
+               knows how long, so don't sit on our log messages */
+            if ( !flushed )
+            {
+                pthread_mutex_unlock( &gPool.lock );
+                logFlush();
+                flushed = 1;
+                pthread_mutex_lock( &gPool.lock );
+                continue;
+            }
+            pthread_cond_wait( &gPool.activeCond, &gPool.lock );
+        }
+        if ( gPool.next >= gPool.added )
+        {
+            pthread_mutex_unlock( &gPool.lock );
+            break;
+        }
+        index = gPool.next++;
+        pthread_mutex_unlock( &gPool.lock );
+        flushed = 0;
+
+        start = statsNow();
+        if ( gPool.workFn( gPool.context, index, worker ) )
+        {
+            __atomic_fetch_add( &gPool.items, 1, __ATOMIC_RELAXED );
+            sample = __atomic_fetch_add( &gPool.sampleCount, 1, __ATOMIC_RELAXED );
+            if ( sample < kPoolSamples )
+            {
+                gPool.samples[sample] = statsNow() - start;
+            }
+        }
+
+        pthread_mutex_lock( &gPool.lock );
+        gPool.done[index % gPool.capacity]   = 1;
+        gPool.doneBy[index % gPool.capacity] = worker;
+        pthread_cond_broadcast( &gPool.doneCond );
+        pthread_mutex_unlock( &gPool.lock );
+    }
+
+    logFlush();
+    return NULL;
+}
+
+/* called with the lock held */
+static void _setActive( unsigned int active )
+{
+    int err;
+
+    while ( gPool.created < active )
+    {
+        err = pthread_create( &gPool.workers[gPool.created], NULL, _worker, (void *)(uintptr_t)gPool.created );
+        if ( err != 0 )
+        {
+            logWarning( "unable to start worker %u (%d: %s)", gPool.created, err, strerror( err ) );
+            active = gPool.created;
+            break;
+        }
+        ++gPool.created;
+    }
+    if ( active < 1 )
+    {
+        logError( "unable to start any workers" );
+        exit( __LINE__ );
+    }
+    gPool.active = active;
+    pthread_cond_broadcast( &gPool.activeCond );
+}
+
+static int _readCpuTimes( tCpuTimes *times )
+{
+    char                buffer[512];
+    unsigned long long  user, nice, system, idle, iowait, irq, softirq, steal;
+    ssize_t             length;
+    int                 fd;
+
+    memset( times, 0, sizeof( tCpuTimes ) );
+
+    fd = open( "/proc/stat", O_RDONLY | O_CLOEXEC );
+    if ( fd == -1 )
+    {
+        return -1;
+    }
+    length = read( fd, buffer, sizeof( buffer ) - 1 );
+    close( fd );
+    if ( length <= 0 )
+    {
+        return -1;
+    }
+    buffer[length] = '\0';
+
+    /* the first line is the total over all the CPUs */
+    if ( sscanf( buffer, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+                 &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal ) != 8 )
+    {
+        return -1;
+    }
+    times->busy   = user + nice + system + irq + softirq + steal;
+    times->iowait = iowait;
+    times->total  = times->busy + idle + iowait;
+
+    return 0;
+}
+
+static int _compareSamples( const void *a, const void *b )
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void *_controller( void * UNUSED(arg) )
+{
+    static uint64_t samples[kPoolSamples];
+    tCpuTimes       before, after;
+    struct timespec deadline;
+    uint64_t        items, p90;
+    unsigned int    sampleCount, active, next;
+    tPoolOptions    options;
+    double          throughput, lastThroughput = 0;
+    double          busy, iowait;
+    const char     *reason;
+    int             stopping;
+    unsigned int    grown = 0;          /* workers added at the last decision */
+    unsigned int    holds = kPoolProbe - 1;    /* decisions in a row that changed nothing - try more workers straight away */
+    int             slowStart = 1;      /* double, rather than add, until the first decrease */
+
+    _readCpuTimes( &before );
+
+    pthread_mutex_lock( &gPool.lock );
+    for ( ;; )
+    {
+        clock_gettime( CLOCK_REALTIME, &deadline );
+        deadline.tv_nsec += kPoolInterval * 1000000L;
+        deadline.tv_sec  += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while ( !gPool.stopping && gPool.options.jobs == 0 && pthread_cond_timedwait( &gPool.activeCond, &gPool.lock, &deadline ) != ETIMEDOUT )
+            { }
+        stopping = gPool.stopping;
+        active   = gPool.active;
+        options  = gPool.options;
+        pthread_mutex_unlock( &gPool.lock );
+
+        if ( stopping || options.jobs != 0 )
+        {
+            /* stopping, or reconfigured to a fixed count */
+            break;
+        }
+
+        /* what happened over the last interval. A worker may still be
+           filling in a sample it claimed before the reset; that's noise */
+        items       = __atomic_exchange_n( &gPool.items, 0, __ATOMIC_RELAXED );
+        sampleCount = __atomic_exchange_n( &gPool.sampleCount, 0, __ATOMIC_RELAXED );
+        if ( sampleCount > kPoolSamples )
+        {
+            sampleCount = kPoolSamples;
+        }
+        memcpy( samples, gPool.samples, sampleCount * sizeof( uint64_t ) );
+        qsort( samples, sampleCount, sizeof( uint64_t ), _compareSamples );
+        p90 = (sampleCount > 0) ? samples[sampleCount * 9 / 10] : 0;
+
+        _readCpuTimes( &after );
+        busy   = (after.total > before.total) ? 100.0 * (after.busy   - before.busy)   / (after.total - before.total) : 0;
+        iowait = (after.total > before.total) ? 100.0 * (after.iowait - before.iowait) / (after.total - before.total) : 0;
+        before = after;
+
+        throughput = items * 1000.0 / kPoolInterval;
+
+        next = active;
+        if ( options.latencyCeiling != 0 && p90 > options.latencyCeiling * 1000000ULL )
+        {
+            next   = active / 2;
+            reason = "over the latency ceiling";
+        }
+        else if ( options.loadCeiling != 0 && busy > options.loadCeiling )
+        {
+            next   = active / 2;
+            reason = "over the load ceiling";
+        }
+        else if ( items == 0 )
+        {
+            reason = "no items finished";    /* e.g. a few very slow files - nothing to go on */
+        }
+        else if ( grown > 0 )
+        {
+            /* did the workers we added last time pay for themselves? */
+            if ( throughput > lastThroughput * 1.05 )
+            {
+                next   = slowStart ? active * 2 : active + kPoolIncrease;
+                reason = "throughput improved";
+            }
+            else
+            {
+                next   = active - grown;
+                reason = "more workers didn't help";
+            }
+        }
+        else if ( ++holds >= kPoolProbe )
+        {
+            /* conditions change (a cold directory, a slower disk), so keep probing */
+            next   = active + kPoolIncrease;
+            reason = "probing";
+        }
+        else
+        {
+            reason = "holding";
+        }
+        if ( next < 1 )
+            { next = 1; }
+        if ( next > kPoolMaxWorkers )
+            { next = kPoolMaxWorkers; }
+        if ( next < active )
+            { slowStart = 0; }
+        if ( next != active )
+            { holds = 0; }
+        grown = (next > active) ? next - active : 0;
+        if ( items != 0 )
+            { lastThroughput = throughput; }
+
+        if ( next != active )
+        {
+            logInfo( "workers %u -> %u (%s): %.0f items/s, p90 %.1f ms, cpu %.0f%%, iowait %.0f%%",
+                     active, next, reason, throughput, p90 / 1e6, busy, iowait );
+        }
+        else
+        {
+            logDebug( "workers %u (%s): %.0f items/s, p90 %.1f ms, cpu %.0f%%, iowait %.0f%%",
+                      active, reason, throughput, p90 / 1e6, busy, iowait );
+        }
+
+        pthread_mutex_lock( &gPool.lock );
+        if ( next != active && !gPool.stopping && gPool.options.jobs == 0 )
+        {
+            _setActive( next );
+        }
+    }
+
+    return NULL;
+}
+
+static void _startController( void )
+{
+    int err;
+
+    err = pthread_create( &gPool.controller, NULL, _controller, NULL );
+    if ( err != 0 )
+    {
+        logWarning( "unable to start the concurrency controller (%d: %s), staying at %u workers",
+                    err, strerror( err ), gPool.active );
+    }
+    else
+    {
+        gPool.controlled = 1;
+    }
+}
+
+/* the number of workers to start with, for 'jobs' (0 for auto) */
+static unsigned int _initialWorkers( unsigned int jobs )
+{
+    long cpus;
+
+    if ( jobs != 0 )
+    {
+        return jobs;
+    }
+    /* start at one per core (as many as there can be on a bigger machine),
+       and let the controller find its way from there. 4 if we can't tell */
+    cpus = sysconf( _SC_NPROCESSORS_ONLN );
+    if ( cpus <= 0 )
+    {
+        return 4;
+    }
+    return (cpus < kPoolMaxWorkers) ? cpus : kPoolMaxWorkers;
+}
+
+int poolStartStream( unsigned int capacity, tPoolWorkFn workFn, void *context, const tPoolOptions *options )
+{
+    gPool.workFn   = workFn;
+    gPool.context  = context;
+    gPool.capacity = (capacity > 0) ? capacity : 1;
+    gPool.options  = *options;
+    gPool.next     = 0;
+    gPool.added    = 0;
+    gPool.released = 0;
+    gPool.ended    = 0;
+    gPool.created  = 0;
+    gPool.stopping = 0;
+    gPool.idle     = NULL;
+    gPool.items    = 0;
+    gPool.sampleCount = 0;
+    gPool.done     = calloc( gPool.capacity, sizeof( uint8_t ) );
+    gPool.doneBy   = calloc( gPool.capacity, sizeof( uint16_t ) );
+    if ( gPool.done == NULL || gPool.doneBy == NULL )
+    {
+        logError( "out of memory" );
+        return -1;
+    }
+
+    pthread_mutex_lock( &gPool.lock );
+    _setActive( _initialWorkers( options->jobs ) );
+    pthread_mutex_unlock( &gPool.lock );
+
+    gPool.controlled = 0;
+    if ( options->jobs == 0 )
+    {
+        _startController();
+    }
+
+    return 0;
+}
+
+int poolStart( unsigned int count, tPoolWorkFn workFn, void *context, const tPoolOptions *options )
+{
+    if ( poolStartStream( count, workFn, context, options ) != 0 )
+    {
+        return -1;
+    }
+    poolAdd( count );
+    poolEnd();
+
+    logInfo( "%u item%s, %u worker%s%s", count, (count == 1) ? "" : "s",
+             gPool.active, (gPool.active == 1) ? "" : "s", gPool.controlled ? " to start with" : "" );
+
+    return 0;
+}
+
+void poolReserve( unsigned int count )
+{
+    pthread_mutex_lock( &gPool.lock );
+    while ( gPool.added + count > gPool.released + gPool.capacity )
+    {
+        pthread_cond_wait( &gPool.releasedCond, &gPool.lock );
+    }
+    pthread_mutex_unlock( &gPool.lock );
+}
+
+void poolAdd( unsigned int count )
+{
+    pthread_mutex_lock( &gPool.lock );
+    for ( unsigned int i = 0; i < count; ++i )
+    {
+        gPool.done[(gPool.added + i) % gPool.capacity] = 0;
+    }
+    gPool.added += count;
+    pthread_cond_broadcast( &gPool.activeCond );
+    pthread_cond_broadcast( &gPool.doneCond );
+    pthread_mutex_unlock( &gPool.lock );
+}
+
+void poolEnd( void )
+{
+    pthread_mutex_lock( &gPool.lock );
+    gPool.ended = 1;
+    pthread_cond_broadcast( &gPool.activeCond );
+    pthread_cond_broadcast( &gPool.doneCond );
+    pthread_mutex_unlock( &gPool.lock );
+}
+
+/* the consumer's wait on doneCond, with the lock held. If it has an idle
+   callback, that is run every kPoolIdle ms, unlocked; the caller checks
+   what it's waiting for again either way */
+static void _consumerWait( void )
+{
+    struct timespec deadline;
+
+    if ( gPool.idle == NULL )
+    {
+        pthread_cond_wait( &gPool.doneCond, &gPool.lock );
+        return;
+    }
+
+    clock_gettime( CLOCK_REALTIME, &deadline );
+    deadline.tv_nsec += kPoolIdle * 1000000L;
+    deadline.tv_sec  += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    if ( pthread_cond_timedwait( &gPool.doneCond, &gPool.lock, &deadline ) == ETIMEDOUT )
+    {
+        pthread_mutex_unlock( &gPool.lock );
+        gPool.idle();
+        pthread_mutex_lock( &gPool.lock );
+    }
+}
+
+int poolMore( unsigned int index )
+{
+    int more;
+
+    pthread_mutex_lock( &gPool.lock );
+    while ( index >= gPool.added && !gPool.ended )
+    {
+        _consumerWait();
+    }
+    more = (index < gPool.added);
+    pthread_mutex_unlock( &gPool.lock );
+
+    return more;
+}
+
+void poolRelease( unsigned int upTo )
+{
+    pthread_mutex_lock( &gPool.lock );
+    if ( upTo > gPool.released )
+    {
+        gPool.released = upTo;
+        pthread_cond_broadcast( &gPool.releasedCond );
+    }
+    pthread_mutex_unlock( &gPool.lock );
+}
+
+void poolSetOptions( const tPoolOptions *options )
+{
+    pthread_mutex_lock( &gPool.lock );
+    gPool.options = *options;
+    if ( options->jobs != 0 || !gPool.controlled )
+    {
+        _setActive( _initialWorkers( options->jobs ) );
+    }
+    pthread_mutex_unlock( &gPool.lock );
+
+    if ( options->jobs != 0 && gPool.controlled )
+    {
+        /* _setActive() woke the controller, and it stops when it sees a fixed count */
+        pthread_join( gPool.controller, NULL );
+        gPool.controlled = 0;
+    }
+    else if ( options->jobs == 0 && !gPool.controlled )
+    {
+        _startController();
+    }
+
+    logInfo( "now %u worker%s%s", gPool.active, (gPool.active == 1) ? "" : "s",
+             gPool.controlled ? ", adapting to the load" : "" );
+}
+
+unsigned int poolWait( unsigned int index )
+{
+    unsigned int worker;
+
+    pthread_mutex_lock( &gPool.lock );
+    while ( !gPool.done[index % gPool.capacity] )
+    {
+        _consumerWait();
+    }
+    worker = gPool.doneBy[index % gPool.capacity];
+    pthread_mutex_unlock( &gPool.lock );
+
+    return worker;
+}
+
+void poolOnIdle( void (*idle)( void ) )
+{
+    pthread_mutex_lock( &gPool.lock );
+    gPool.idle = idle;
+    pthread_mutex_unlock( &gPool.lock );
+}
+
+void poolStop( void )
+{
+    pthread_mutex_lock( &gPool.lock );
+    gPool.stopping = 1;
+    pthread_cond_broadcast( &gPool.activeCond );
+    pthread_mutex_unlock( &gPool.lock );
+
+    if ( gPool.controlled )
+    {
+        pthread_join( gPool.controller, NULL );
+    }
+    for ( unsigned int w = 0; w < gPool.created; ++w )
+    {
+        pthread_join( gPool.workers[w], NULL );
+    }
+
+    free( gPool.done );
+    free( gPool.doneBy );
+    gPool.done   = NULL;
+    gPool.doneBy = NULL;
+}
@@ -0,0 +1,59 @@
+/*
+    a pool of worker threads, with a fixed size or one that adapts to the load
+*/
+
+#ifndef POOL_H
+#define POOL_H
+
+#define kPoolMaxWorkers     512
+
+typedef struct {
+    unsigned int    jobs;               /* worker count, or 0 for auto */
+    unsigned int    latencyCeiling;     /* auto: shrink if the p90 per-item time goes over this (ms), 0 for none */
+    unsigned int    loadCeiling;        /* auto: shrink if the CPUs are busier than this (percent), 0 for none */
+} tPoolOptions;
+
+/* does item 'index' on worker 'worker'. Returns non-zero if it did real
+   work, i.e. it should count towards the throughput */
+typedef int (*tPoolWorkFn)( void *context, unsigned int index, unsigned int worker );
+
+/* parse "N" or "auto". Returns 0 on success */
+int             parsePoolJobs( const char *text, unsigned int *jobs );
+
+/* start working through items 0 .. count-1, in order, in the background */
+int             poolStart( unsigned int count, tPoolWorkFn workFn, void *context, const tPoolOptions *options );
+
+/* or start on a stream of items, added as they arrive. Item i lives in
+   slot i % capacity (of the caller's arrays too) until it's released */
+int             poolStartStream( unsigned int capacity, tPoolWorkFn workFn, void *context, const tPoolOptions *options );
+
+/* producer: wait until there are 'count' free slots, fill them in, then
+   add them. poolEnd() when there are no more */
+void            poolReserve( unsigned int count );
+void            poolAdd( unsigned int count );
+void            poolEnd( void );
+
+/* consumer: wait until item 'index' has been added, or the items have
+   ended. Returns non-zero if there is an item 'index' */
+int             poolMore( unsigned int index );
+
+/* consumer: the items before 'upTo' are finished with, their slots can be reused */
+void            poolRelease( unsigned int upTo );
+
+/* change the worker count or the ceilings while it's running. Only the
+   thread that called poolStart() may call this */
+void            poolSetOptions( const tPoolOptions *options );
+
+/* wait until item 'index' is done, and return the worker that did it */
+unsigned int    poolWait( unsigned int index );
+
+/* consumer: while poolMore() or poolWait() is waiting, call idle() every
+   so often, on the consumer's thread with nothing locked - e.g. to apply a
+   reload while a stream of items has gone quiet. NULL for none; call after
+   starting the pool */
+void            poolOnIdle( void (*idle)( void ) );
+
+/* wait for all the workers to finish, and clean up */
+void            poolStop( void );
+
+#endif
@@ -0,0 +1,301 @@
+/*
+    Probes a media file with libavformat, and reports what's in it. Whether
+    that will play on the target device is deviceVerdict()'s decision, made
+    by the caller: the probing knows nothing about devices.
+
+    The file is read through our own AVIOContext rather than libavformat's
+    file protocol, so we can count exactly how much I/O each probe costs.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/pixdesc.h>
+
+#include "common.h"
+#include "logging.h"
+#include "probe.h"
+#include "stats.h"
+
+#define kProbeBufferSize    (64 * 1024)
+
+static const char *verdictStrings[] = {
+    [kVerdictError]     = "error",
+    [kVerdictPlayable]  = "playable",
+    [kVerdictRemux]     = "remux",
+    [kVerdictTranscode] = "transcode"
+};
+
+static const char *stageStrings[] = {
+    [kStageOpen]    = "open",
+    [kStageProbe]   = "probe",
+    [kStageAnalyse] = "analyse",
+    [kStageVerdict] = "verdict",
+    [kStageOutput]  = "output"
+};
+
+const char *verdictToString( eVerdict verdict )
+{
+    return (verdict < kVerdictMax) ? verdictStrings[verdict] : "?";
+}
+
+const char *stageToString( eStage stage )
+{
+    return (stage < kStageMax) ? stageStrings[stage] : "?";
+}
+
+/*
+ * custom I/O, counting every syscall
+ */
+
+typedef struct {
+    int             fd;
+    int64_t         size;
+    tProbeResult   *result;
+} tProbeIO;
+
+static int _probeRead( void *opaque, uint8_t *buffer, int size )
+{
+    tProbeIO   *io = opaque;
+    ssize_t     count;
+
+    do {
+        count = read( io->fd, buffer, size );
+        ++io->result->syscalls;
+    } while ( count < 0 && errno == EINTR );
+
+    if ( count < 0 )
+    {
+        return AVERROR( errno );
+    }
+    if ( count == 0 )
+    {
+        return AVERROR_EOF;
+    }
+    io->result->bytesRead += count;
+
+    return count;
+}
+
+static int64_t _probeSeek( void *opaque, int64_t offset, int whence )
+{
+    tProbeIO   *io = opaque;
+    off_t       position;
+
+    if ( whence & AVSEEK_SIZE )
+    {
+        /* we already know, from the fstat() */
+        return io->size;
+    }
+
+    position = lseek( io->fd, offset, whence & ~AVSEEK_FORCE );
+    ++io->result->syscalls;
+
+    return (position < 0) ? AVERROR( errno ) : position;
+}
+
+/* route libavformat's complaints into our 'probe' scope. Damaged files are
+   expected, so its errors are only Info here */
+static void _probeAVLog( void * UNUSED(avcl), int level, const char *format, va_list vaptr )
+{
+    tPriority   priority;
+    char        msg[256];
+    size_t      length;
+
+    if ( level <= AV_LOG_ERROR )
+        { priority = kLogInfo; }
+    else if ( level <= AV_LOG_WARNING )
+        { priority = kLogDebug; }
+    else
+        { return; }
+
+    if ( logCheck( priority, LOG_SCOPE ) )
+    {
+        vsnprintf( msg, sizeof( msg ), format, vaptr );
+        length = strlen( msg );
+        if ( length > 0 && msg[length - 1] == '\n' )
+        {
+            msg[length - 1] = '\0';
+        }
+        log( priority, "libav: %s", msg );
+    }
+}
+
+void initProbe( void )
+{
+    av_log_set_callback( _probeAVLog );
+}
+
+static int _bitDepth( const AVCodecParameters *par )
+{
+    const AVPixFmtDescriptor *desc;
+
+    if ( par->bits_per_raw_sample > 0 )
+    {
+        return par->bits_per_raw_sample;
+    }
+    desc = av_pix_fmt_desc_get( par->format );
+    return (desc != NULL) ? desc->comp[0].depth : 0;
+}
+
+/* record the time spent in the current stage, and move on to the next */
+static void _endStage( tProbeResult *result, eStage *stage, uint64_t *start )
+{
+    uint64_t now = statsNow();
+
+    result->stageNs[*stage] = now - *start;
+    *start = now;
+    ++*stage;
+}
+
+int probeFile( const char *path, tProbeResult *result )
+{
+    tProbeIO            io;
+    struct stat         st;
+    AVFormatContext    *format = NULL;
+    AVIOContext        *avio   = NULL;
+    unsigned char      *buffer;
+    AVCodecParameters  *par;
+    const char         *comma;
+    size_t              length;
+    int                 stream;
+    int                 err;
+    uint64_t            start;
+    eStage              stage = kStageOpen;
+
+    start = statsNow();
+    memset( result, 0, sizeof( tProbeResult ) );
+    result->verdict    = kVerdictError;
+    result->videoCodec = AV_CODEC_ID_NONE;
+    result->audioCodec = AV_CODEC_ID_NONE;
+
+    io.result = result;
+    io.fd = open( path, O_RDONLY | O_CLOEXEC );
+    ++result->syscalls;
+    if ( io.fd == -1 )
+    {
+        err = AVERROR( errno );
+        logDebug( "unable to open \"%s\" (%d: %s)", path, errno, strerror( errno ) );
+        _endStage( result, &stage, &start );
+        return err;
+    }
+
+    err = fstat( io.fd, &st );
+    ++result->syscalls;
+    if ( err != 0 )
+    {
+        err = AVERROR( errno );
+        goto done;
+    }
+    io.size = st.st_size;
+
+    buffer = av_malloc( kProbeBufferSize );
+    avio   = (buffer != NULL) ? avio_alloc_context( buffer, kProbeBufferSize, 0, &io, _probeRead, NULL, _probeSeek ) : NULL;
+    format = avformat_alloc_context();
+    if ( avio == NULL || format == NULL )
+    {
+        if ( avio == NULL )
+        {
+            av_free( buffer );
+        }
+        avformat_free_context( format );
+        format = NULL;
+        err = AVERROR( ENOMEM );
+        goto done;
+    }
+    format->pb     = avio;
+    format->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    _endStage( result, &stage, &start );
+
+    /* the path is only used as a hint (by file extension) */
+    err = avformat_open_input( &format, path, NULL, NULL );
+    if ( err < 0 )
+    {
+        /* format has been freed, but not our I/O context */
+        logDebug( "\"%s\" isn't a container we recognize (%s)", path, av_err2str( err ) );
+        goto done;
+    }
+
+    _endStage( result, &stage, &start );
+
+    err = avformat_find_stream_info( format, NULL );
+    if ( err < 0 )
+    {
+        logDebug( "unable to analyse the streams in \"%s\" (%s)", path, av_err2str( err ) );
+        goto done;
+    }
+
+    _endStage( result, &stage, &start );
+
+    comma  = strchr( format->iformat->name, ',' );
+    length = (comma != NULL) ? (size_t)(comma - format->iformat->name) : strlen( format->iformat->name );
+    if ( length >= sizeof( result->container ) )
+    {
+        length = sizeof( result->container ) - 1;
+    }
+    memcpy( result->container, format->iformat->name, length );
+    result->container[length] = '\0';
+
+    result->bitRate  = format->bit_rate;
+    result->duration = (format->duration != AV_NOPTS_VALUE) ? format->duration / (AV_TIME_BASE / 1000) : 0;
+
+    stream = av_find_best_stream( format, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0 );
+    if ( stream >= 0 )
+    {
+        par = format->streams[stream]->codecpar;
+        result->videoCodec = par->codec_id;
+        result->width      = par->width;
+        result->height     = par->height;
+        result->bitDepth   = _bitDepth( par );
+    }
+
+    stream = av_find_best_stream( format, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0 );
+    if ( stream >= 0 )
+    {
+        result->audioCodec = format->streams[stream]->codecpar->codec_id;
+    }
+
+    _endStage( result, &stage, &start );
+
+done:
+    if ( err < 0 )
+    {
+        /* charge the failure to the stage it happened in */
+        _endStage( result, &stage, &start );
+    }
+    if ( format != NULL )
+    {
+        avformat_close_input( &format );
+    }
+    if ( avio != NULL )
+    {
+        av_freep( &avio->buffer );
+        avio_context_free( &avio );
+    }
+    close( io.fd );
+    ++result->syscalls;
+
+    return (err < 0) ? err : 0;
+}
+
+void printProbeResult( FILE *output, const char *path, const tProbeResult *result )
+{
+    fprintf( output, "%s\t%s\t%s\t%s\t%dx%d\t%d\t%s\t%lld\n",
+             path,
+             verdictToString( result->verdict ),
+             (result->container[0] != '\0') ? result->container : "-",
+             (result->videoCodec != AV_CODEC_ID_NONE) ? avcodec_get_name( result->videoCodec ) : "-",
+             result->width, result->height, result->bitDepth,
+             (result->audioCodec != AV_CODEC_ID_NONE) ? avcodec_get_name( result->audioCodec ) : "-",
+             (long long)(result->bitRate / 1000) );
+}
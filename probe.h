@@ -0,0 +1,61 @@
+/*
+    probing a media file, for its container and streams
+*/
+
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef enum {
+    kVerdictError,          /* couldn't be opened, or isn't media we understand */
+    kVerdictPlayable,       /* plays as-is */
+    kVerdictRemux,          /* the streams are fine, the container isn't */
+    kVerdictTranscode,      /* at least one stream has to be re-encoded */
+    kVerdictMax
+} eVerdict;
+
+/* the stages of handling one file, timed separately */
+typedef enum {
+    kStageOpen,             /* open() & fstat(), setting up the I/O context */
+    kStageProbe,            /* identifying the container, reading its header */
+    kStageAnalyse,          /* avformat_find_stream_info() */
+    kStageVerdict,          /* picking the streams, checking them against the device (see device.h) */
+    kStageOutput,           /* writing the result (timed by the caller) */
+    kStageMax
+} eStage;
+
+typedef struct {
+    eVerdict        verdict;
+    char            container[16];  /* short name of the demuxer, e.g. "mov" or "matroska" */
+    int             videoCodec;     /* enum AVCodecID, or AV_CODEC_ID_NONE */
+    int             audioCodec;     /* enum AVCodecID, or AV_CODEC_ID_NONE */
+    int             width;
+    int             height;
+    int             bitDepth;       /* of the video, 0 if unknown */
+    int64_t         bitRate;        /* bits/sec, overall */
+    int64_t         duration;       /* milliseconds */
+
+    /* I/O done on the file while probing it */
+    uint64_t        bytesRead;
+    unsigned int    syscalls;       /* open, fstat, read, lseek and close */
+
+    uint64_t        stageNs[kStageMax];     /* time spent in each stage, stages not reached are 0 */
+} tProbeResult;
+
+/* call once, before probing anything */
+void            initProbe( void );
+
+/* probe a file. result is always filled in, its verdict left kVerdictError
+   for deviceVerdict() to decide; returns 0 if the file could be opened and
+   analysed, otherwise a negative AVERROR */
+int             probeFile( const char *path, tProbeResult *result );
+
+const char *    verdictToString( eVerdict verdict );
+const char *    stageToString( eStage stage );
+
+/* the per-file line that fftest outputs: tab separated, path first */
+void            printProbeResult( FILE *output, const char *path, const tProbeResult *result );
+
+#endif
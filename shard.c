@@ -0,0 +1,166 @@
+/*
+    Deterministic sharding.
+
+    Each path is assigned to a shard by a 64 bit FNV-1a hash of its bytes,
+    which is the same on every host and every run, so N processes given the
+    same file list and --shard 0/N .. N-1/N divide it between them without
+    talking to each other. Every path lands in exactly one shard.
+
+    The shards' output lines are merged by path, which gives the same result
+    set however the work was divided (and the same as an unsharded scan,
+    once that's sorted the same way).
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "common.h"
+#include "logging.h"
+#include "shard.h"
+
+int parseShard( const char *text, tShard *shard )
+{
+    unsigned int    index, count;
+    int             length = 0;
+
+    if ( sscanf( text, "%u/%u%n", &index, &count, &length ) != 2 || text[length] != '\0'
+      || count == 0 || index >= count )
+    {
+        logError( "\"%s\" isn't a shard - expected i/N, with 0 <= i < N", text );
+        return -1;
+    }
+    shard->index = index;
+    shard->count = count;
+
+    return 0;
+}
+
+static uint64_t _hashPath( const char *path )
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    while ( *path != '\0' )
+    {
+        hash ^= (unsigned char)*path++;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+int inShard( const tShard *shard, const char *path )
+{
+    uint64_t hash;
+
+    if ( shard->count <= 1 )
+    {
+        return 1;
+    }
+    /* the low bits of FNV-1a are its weakest, so fold the high ones in */
+    hash = _hashPath( path );
+    return ((hash ^ (hash >> 32)) % shard->count) == shard->index;
+}
+
+/*
+ * merging
+ */
+
+typedef struct {
+    char           *line;
+    size_t          pathLength;     /* up to the first tab */
+} tMergeLine;
+
+static int _byPath( const void *a, const void *b )
+{
+    const tMergeLine   *x = a, *y = b;
+    size_t              length = (x->pathLength < y->pathLength) ? x->pathLength : y->pathLength;
+    int                 diff;
+
+    diff = memcmp( x->line, y->line, length );
+    if ( diff != 0 )
+    {
+        return diff;
+    }
+    return (x->pathLength > y->pathLength) - (x->pathLength < y->pathLength);
+}
+
+int mergeShards( FILE *output, int count, const char *files[] )
+{
+    tMergeLine     *lines = NULL;
+    size_t          lineCount = 0, allocated = 0;
+    char           *line = NULL;
+    size_t          size = 0;
+    ssize_t         length;
+    FILE           *input;
+    char           *tab;
+    int             result = 0;
+    size_t          i;
+
+    for ( int f = 0; f < count && result == 0; ++f )
+    {
+        input = fopen( files[f], "r" );
+        if ( input == NULL )
+        {
+            logError( "unable to open \"%s\" (%d: %s)", files[f], errno, strerror( errno ) );
+            result = -1;
+            break;
+        }
+
+        while ( (length = getline( &line, &size, input )) > 0 )
+        {
+            if ( line[length - 1] != '\n' )
+            {
+                logWarning( "the last line of \"%s\" is incomplete - was that shard interrupted?", files[f] );
+                continue;
+            }
+            if ( lineCount == allocated )
+            {
+                allocated = (allocated == 0) ? 1024 : allocated * 2;
+                lines = realloc( lines, allocated * sizeof( tMergeLine ) );
+                if ( lines == NULL )
+                {
+                    logError( "out of memory" );
+                    exit( __LINE__ );
+                }
+            }
+            tab = memchr( line, '\t', length );
+            lines[lineCount].pathLength = (tab != NULL) ? (size_t)(tab - line) : (size_t)length - 1;
+            lines[lineCount].line       = line;
+            ++lineCount;
+
+            /* getline() allocates a fresh buffer next time round */
+            line = NULL;
+            size = 0;
+        }
+        fclose( input );
+    }
+    free( line );
+
+    if ( result == 0 )
+    {
+        qsort( lines, lineCount, sizeof( tMergeLine ), _byPath );
+
+        for ( i = 0; i < lineCount; ++i )
+        {
+            /* a path in two shards means they were given different counts */
+            if ( i > 0 && _byPath( &lines[i - 1], &lines[i] ) == 0 )
+            {
+                logWarning( "%.*s appears more than once - were the shards given different counts?", (int)lines[i].pathLength, lines[i].line );
+                continue;
+            }
+            fputs( lines[i].line, output );
+        }
+        logInfo( "merged %zu results from %d shard%s", lineCount, count, (count == 1) ? "" : "s" );
+    }
+
+    for ( i = 0; i < lineCount; ++i )
+    {
+        free( lines[i].line );
+    }
+    free( lines );
+
+    return result;
+}
@@ -0,0 +1,26 @@
+/*
+    splitting a scan across several processes or machines, and merging the results
+*/
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdio.h>
+
+typedef struct {
+    unsigned int    index;          /* this process's shard, 0 .. count-1 */
+    unsigned int    count;          /* 1 if the scan isn't sharded */
+} tShard;
+
+/* parse "i/N". Returns 0 on success */
+int     parseShard( const char *text, tShard *shard );
+
+/* non-zero if path belongs to this shard. Depends only on the bytes of the
+   path, so every host has to be given the same paths (e.g. the same mount point) */
+int     inShard( const tShard *shard, const char *path );
+
+/* merge the outputs of several shards into one result set, sorted by path.
+   Returns 0 on success */
+int     mergeShards( FILE *output, int count, const char *files[] );
+
+#endif
@@ -0,0 +1,386 @@
+/*
+    Per-stage latency histograms and counters.
+
+    Each worker has a tStatsWorker in a shared mapping, for the files it
+    probed. They are all written by one thread, fftest's consumer, which
+    records each file as it takes the result (after timing the output), so
+    updates are plain (relaxed atomic) stores - no locks, no locked
+    instructions. A reader in another process
+    ('fftest --stats <file>') maps the same file read-only and merges the
+    workers as it goes; at worst it sees a file counted but one of its
+    stages not yet, which is fine for monitoring.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "logging.h"
+#include "probe.h"
+#include "stats.h"
+
+static tStatsFile  *gStats;
+static size_t       gStatsSize;
+
+/* the single writer of a counter bumps it like this; readers use _load() */
+#define _add( field, value )    __atomic_store_n( &(field), (field) + (value), __ATOMIC_RELAXED )
+#define _load( field )          __atomic_load_n( &(field), __ATOMIC_RELAXED )
+
+static unsigned int _bucket( uint64_t ns )
+{
+    unsigned int exponent;
+
+    if ( ns < kStatsSubCount )
+    {
+        return ns;
+    }
+    exponent = 63 - __builtin_clzll( ns );
+    return (exponent - kStatsSubBits + 1) * kStatsSubCount
+         + ((ns >> (exponent - kStatsSubBits)) & (kStatsSubCount - 1));
+}
+
+/* the smallest value that lands in a bucket */
+static uint64_t _bucketLow( unsigned int bucket )
+{
+    unsigned int exponent;
+
+    if ( bucket < kStatsSubCount )
+    {
+        return bucket;
+    }
+    exponent = bucket / kStatsSubCount + kStatsSubBits - 1;
+    return (uint64_t)(kStatsSubCount + bucket % kStatsSubCount) << (exponent - kStatsSubBits);
+}
+
+static size_t _statsSize( unsigned int workerCount )
+{
+    return sizeof( tStatsFile ) + workerCount * sizeof( tStatsWorker );
+}
+
+int statsOpen( const char *path, unsigned int workerCount )
+{
+    void   *memory;
+    int     fd = -1;
+
+    gStatsSize = _statsSize( workerCount );
+
+    if ( path == NULL )
+    {
+        memory = mmap( NULL, gStatsSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    }
+    else
+    {
+        /* replaced, never rewritten in place, in case a reader still has the old one mapped */
+        unlink( path );
+        fd = open( path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644 );
+        if ( fd == -1 || ftruncate( fd, gStatsSize ) != 0 )
+        {
+            logError( "unable to create the stats file \"%s\" (%d: %s)", path, errno, strerror( errno ) );
+            if ( fd != -1 )
+            {
+                close( fd );
+            }
+            return -1;
+        }
+        memory = mmap( NULL, gStatsSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        close( fd );
+    }
+    if ( memory == MAP_FAILED )
+    {
+        logError( "unable to map the stats (%d: %s)", errno, strerror( errno ) );
+        return -1;
+    }
+
+    gStats = memory;
+    gStats->version     = kStatsVersion;
+    gStats->workerCount = workerCount;
+    gStats->stageCount  = kStageMax;
+    gStats->bucketCount = kStatsBuckets;
+    gStats->pid         = getpid();
+    gStats->started     = time( NULL );
+    /* the magic goes in last, so a reader never sees a half-initialized header */
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    memcpy( gStats->magic, kStatsMagic, sizeof( gStats->magic ) );
+
+    logDebug( "stats for %u worker%s %s %s", workerCount, (workerCount == 1) ? "" : "s",
+              (path != NULL) ? "published to" : "kept", (path != NULL) ? path : "privately" );
+
+    return 0;
+}
+
+tStatsWorker *statsWorker( unsigned int index )
+{
+    return (gStats != NULL && index < gStats->workerCount) ? &gStats->workers[index] : NULL;
+}
+
+void statsRecord( tStatsWorker *worker, const tProbeResult *result, int err )
+{
+    tStatsHistogram    *histogram;
+    uint64_t            ns;
+
+    if ( worker == NULL )
+    {
+        return;
+    }
+
+    for ( int stage = 0; stage < kStageMax; ++stage )
+    {
+        ns = result->stageNs[stage];
+        if ( ns == 0 )
+        {
+            continue;   /* never got that far */
+        }
+        histogram = &worker->stages[stage];
+        _add( histogram->buckets[_bucket( ns )], 1 );
+        _add( histogram->totalNs, ns );
+        if ( ns > histogram->maxNs )
+        {
+            __atomic_store_n( &histogram->maxNs, ns, __ATOMIC_RELAXED );
+        }
+        _add( histogram->count, 1 );
+    }
+
+    _add( worker->bytesRead, result->bytesRead );
+    _add( worker->syscalls, result->syscalls );
+    _add( worker->verdicts[result->verdict], 1 );
+    if ( err != 0 )
+    {
+        _add( worker->errors, 1 );
+    }
+    _add( worker->files, 1 );
+
+    logDebug( "open %llu, probe %llu, analyse %llu, verdict %llu, output %llu us",
+              (unsigned long long)result->stageNs[kStageOpen]    / 1000,
+              (unsigned long long)result->stageNs[kStageProbe]   / 1000,
+              (unsigned long long)result->stageNs[kStageAnalyse] / 1000,
+              (unsigned long long)result->stageNs[kStageVerdict] / 1000,
+              (unsigned long long)result->stageNs[kStageOutput]  / 1000 );
+}
+
+/*
+ * summarizing, for both the log and 'fftest --stats'
+ */
+
+typedef struct {
+    uint64_t        files;
+    uint64_t        errors;
+    uint64_t        bytesRead;
+    uint64_t        syscalls;
+    uint64_t        verdicts[kVerdictMax];
+    tStatsHistogram stages[kStageMax];
+} tStatsTotals;
+
+static void _merge( const tStatsFile *stats, tStatsTotals *totals )
+{
+    const tStatsWorker *worker;
+    uint64_t            max;
+
+    memset( totals, 0, sizeof( tStatsTotals ) );
+
+    for ( unsigned int w = 0; w < stats->workerCount; ++w )
+    {
+        worker = &stats->workers[w];
+        totals->files     += _load( worker->files );
+        totals->errors    += _load( worker->errors );
+        totals->bytesRead += _load( worker->bytesRead );
+        totals->syscalls  += _load( worker->syscalls );
+        for ( int v = 0; v < kVerdictMax; ++v )
+        {
+            totals->verdicts[v] += _load( worker->verdicts[v] );
+        }
+        for ( int s = 0; s < kStageMax; ++s )
+        {
+            totals->stages[s].count   += _load( worker->stages[s].count );
+            totals->stages[s].totalNs += _load( worker->stages[s].totalNs );
+            max = _load( worker->stages[s].maxNs );
+            if ( max > totals->stages[s].maxNs )
+            {
+                totals->stages[s].maxNs = max;
+            }
+            for ( int b = 0; b < kStatsBuckets; ++b )
+            {
+                totals->stages[s].buckets[b] += _load( worker->stages[s].buckets[b] );
+            }
+        }
+    }
+}
+
+/* the value at a percentile, to within the precision of a bucket */
+static uint64_t _percentile( const tStatsHistogram *histogram, double percent )
+{
+    uint64_t    target, seen = 0, count = 0;
+    int         b;
+
+    for ( b = 0; b < kStatsBuckets; ++b )
+    {
+        count += histogram->buckets[b];
+    }
+    if ( count == 0 )
+    {
+        return 0;
+    }
+
+    target = (uint64_t)(percent / 100.0 * count + 0.5);
+    if ( target < 1 )
+    {
+        target = 1;
+    }
+    for ( b = 0; b < kStatsBuckets; ++b )
+    {
+        seen += histogram->buckets[b];
+        if ( seen >= target )
+        {
+            break;
+        }
+    }
+    /* report the middle of the bucket, but never more than the actual maximum */
+    if ( b + 1 < kStatsBuckets )
+    {
+        uint64_t middle = (_bucketLow( b ) + _bucketLow( b + 1 )) / 2;
+        return (middle < histogram->maxNs) ? middle : histogram->maxNs;
+    }
+    return histogram->maxNs;
+}
+
+/* one line per stage, to a callback, so the same text can go to the log or to stdout */
+typedef void (*tLineFn)( void *context, const char *line );
+
+static void _summarize( const tStatsFile *stats, tLineFn lineFn, void *context )
+{
+    tStatsTotals            totals;
+    const tStatsHistogram  *h;
+    char                    line[256];
+    double                  n;
+
+    _merge( stats, &totals );
+    n = (totals.files > 0) ? totals.files : 1;
+
+    snprintf( line, sizeof( line ),
+              "%llu files, %llu errors (%llu playable, %llu remux, %llu transcode), %.0f bytes & %.1f syscalls per file",
+              (unsigned long long)totals.files, (unsigned long long)totals.errors,
+              (unsigned long long)totals.verdicts[kVerdictPlayable],
+              (unsigned long long)totals.verdicts[kVerdictRemux],
+              (unsigned long long)totals.verdicts[kVerdictTranscode],
+              totals.bytesRead / n, totals.syscalls / n );
+    lineFn( context, line );
+
+    snprintf( line, sizeof( line ), "%-8s %8s %10s %10s %10s %10s %10s %10s",
+              "stage", "count", "mean us", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us" );
+    lineFn( context, line );
+
+    for ( int s = 0; s < kStageMax; ++s )
+    {
+        h = &totals.stages[s];
+        snprintf( line, sizeof( line ), "%-8s %8llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f",
+                  stageToString( s ), (unsigned long long)h->count,
+                  (h->count > 0) ? h->totalNs / 1000.0 / h->count : 0.0,
+                  _percentile( h, 50 ) / 1000.0,
+                  _percentile( h, 90 ) / 1000.0,
+                  _percentile( h, 99 ) / 1000.0,
+                  _percentile( h, 99.9 ) / 1000.0,
+                  h->maxNs / 1000.0 );
+        lineFn( context, line );
+    }
+}
+
+static void _logLine( void * UNUSED(context), const char *line )
+{
+    logInfo( "%s", line );
+}
+
+void statsLogSummary( void )
+{
+    if ( gStats != NULL && logCheck( kLogInfo, LOG_SCOPE ) )
+    {
+        _summarize( gStats, _logLine, NULL );
+    }
+}
+
+void statsClose( void )
+{
+    if ( gStats != NULL )
+    {
+        __atomic_store_n( &gStats->finished, 1, __ATOMIC_RELEASE );
+        munmap( gStats, gStatsSize );
+        gStats = NULL;
+    }
+}
+
+/*
+ * the reader's side
+ */
+
+static void _printLine( void *context, const char *line )
+{
+    fprintf( (FILE *)context, "%s\n", line );
+}
+
+int statsPrint( FILE *output, const char *path )
+{
+    const tStatsFile   *stats;
+    struct stat         st;
+    void               *memory;
+    int                 fd;
+    unsigned int        used = 0;
+
+    fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd == -1 || fstat( fd, &st ) != 0 )
+    {
+        logError( "unable to open the stats file \"%s\" (%d: %s)", path, errno, strerror( errno ) );
+        if ( fd != -1 )
+        {
+            close( fd );
+        }
+        return -1;
+    }
+    if ( (size_t)st.st_size < sizeof( tStatsFile ) )
+    {
+        logError( "\"%s\" is not a stats file", path );
+        close( fd );
+        return -1;
+    }
+    memory = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( memory == MAP_FAILED )
+    {
+        logError( "unable to map the stats file \"%s\" (%d: %s)", path, errno, strerror( errno ) );
+        return -1;
+    }
+
+    stats = memory;
+    if ( memcmp( stats->magic, kStatsMagic, sizeof( stats->magic ) ) != 0
+      || stats->version != kStatsVersion
+      || stats->stageCount != kStageMax || stats->bucketCount != kStatsBuckets
+      || (size_t)st.st_size < _statsSize( stats->workerCount ) )
+    {
+        logError( "\"%s\" is not a stats file (or is from a different version)", path );
+        munmap( memory, st.st_size );
+        return -1;
+    }
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+
+    /* there's room for more workers than the scan may have used */
+    for ( unsigned int w = 0; w < stats->workerCount; ++w )
+    {
+        used += (_load( stats->workers[w].files ) != 0);
+    }
+
+    fprintf( output, "pid %d, %u worker%s used, %s\n", stats->pid, used,
+             (used == 1) ? "" : "s",
+             _load( stats->finished ) ? "finished"
+                                      : (kill( stats->pid, 0 ) == 0 || errno == EPERM) ? "running" : "exited" );
+    _summarize( stats, _printLine, output );
+
+    munmap( memory, st.st_size );
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+    per-stage latency histograms and counters, published live through a
+    memory-mapped stats file (read it with 'fftest --stats <file>')
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "probe.h"
+
+/*
+    HDR-style log-linear buckets: each power of two of nanoseconds is split
+    into 2^kStatsSubBits linear sub-buckets, so every bucket is within 12.5%
+    of the values in it, from 1ns up to the full range of a uint64_t.
+*/
+#define kStatsSubBits   3
+#define kStatsSubCount  (1 << kStatsSubBits)
+#define kStatsBuckets   ((64 - kStatsSubBits + 1) * kStatsSubCount)
+
+#define kStatsMagic     "FFTSTAT1"
+#define kStatsVersion   1
+
+typedef struct {
+    uint64_t        count;
+    uint64_t        totalNs;
+    uint64_t        maxNs;
+    uint64_t        buckets[kStatsBuckets];
+} tStatsHistogram;
+
+/* one per worker, counting the files it probed. Only ever written by one
+   thread, the one taking the results (see statsRecord) */
+typedef struct {
+    uint64_t        files;
+    uint64_t        errors;
+    uint64_t        bytesRead;
+    uint64_t        syscalls;
+    uint64_t        verdicts[kVerdictMax];
+    tStatsHistogram stages[kStageMax];
+} __attribute__((aligned(64))) tStatsWorker;
+
+/* the layout of the stats file */
+typedef struct {
+    char            magic[8];       /* kStatsMagic */
+    uint32_t        version;        /* kStatsVersion */
+    uint32_t        workerCount;
+    uint32_t        stageCount;     /* kStageMax */
+    uint32_t        bucketCount;    /* and kStatsBuckets, of the writer */
+    int32_t         pid;            /* of the scan */
+    uint32_t        finished;       /* non-zero once the scan is over */
+    int64_t         started;        /* wall clock, seconds since the epoch */
+    tStatsWorker    workers[];
+} __attribute__((aligned(64))) tStatsFile;
+
+/* the clock used for all stage timings. CLOCK_MONOTONIC is read through the
+   vDSO, so this doesn't make a syscall */
+static inline uint64_t statsNow( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* set up the stats for workerCount workers. If path isn't NULL they are
+   published there, otherwise kept in anonymous memory. Returns 0 on success */
+int             statsOpen( const char *path, unsigned int workerCount );
+
+/* the stats that worker 'index' updates */
+tStatsWorker *  statsWorker( unsigned int index );
+
+/* add one probed file (counters and stage timings) to a worker's stats.
+   Not thread safe: every call has to come from the same thread */
+void            statsRecord( tStatsWorker *worker, const tProbeResult *result, int err );
+
+/* log a summary of the stats so far at Info, through the 'stats' scope */
+void            statsLogSummary( void );
+
+/* mark the stats finished, and unmap them */
+void            statsClose( void );
+
+/* read a stats file published by another process, and print a summary */
+int             statsPrint( FILE *output, const char *path );
+
+#endif
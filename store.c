@@ -0,0 +1,768 @@
+/*
+    A columnar store of probe results.
+
+    Every field is a column of fixed-width values, laid out at page-aligned
+    offsets that follow from the counts in the header (like the segments of
+    the OUI database in common.c, but sized by the data), so a query maps
+    the file and scans the columns it needs without parsing anything. Paths
+    are split into a directory, kept once in a dictionary, and a name;
+    'under /movies' is matched against the (few) directories once, and the
+    rows then only need a lookup by directory index.
+
+    Queries run a block of rows at a time: each predicate ANDs its result
+    into a byte mask with a branch-free loop the compiler vectorizes, and
+    only the rows left standing at the end of the block are looked at.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <libavcodec/avcodec.h>
+
+#include "common.h"
+#include "logging.h"
+#include "probe.h"
+#include "stats.h"
+#include "store.h"
+
+#define kStorePage          4096
+#define kStoreMaxContainers 256
+#define kStoreBlock         4096    /* rows per pass of the predicates */
+
+#define _roundUp( value, to )   ( ((value) + (to) - 1) / (to) * (to) )
+
+uint64_t storeLayout( const tStoreHeader *header, uint64_t offset[kColumnMax], uint64_t size[kColumnMax] )
+{
+    uint64_t rows = header->rowCount;
+    uint64_t next = kStorePage;     /* the header gets a page to itself */
+
+    size[kColumnVerdict]          = rows * sizeof( uint8_t );
+    size[kColumnContainer]        = rows * sizeof( uint8_t );
+    size[kColumnVideo]            = rows * sizeof( uint32_t );
+    size[kColumnAudio]            = rows * sizeof( uint32_t );
+    size[kColumnWidth]            = rows * sizeof( uint16_t );
+    size[kColumnHeight]           = rows * sizeof( uint16_t );
+    size[kColumnBitDepth]         = rows * sizeof( uint8_t );
+    size[kColumnKbps]             = rows * sizeof( uint32_t );
+    size[kColumnSeconds]          = rows * sizeof( uint32_t );
+    size[kColumnDirectory]        = rows * sizeof( uint32_t );
+    size[kColumnNameOffset]       = rows * sizeof( uint32_t );
+    size[kColumnContainerNames]   = header->containerCount * 16;
+    size[kColumnDirectoryOffsets] = header->directoryCount * sizeof( uint32_t );
+    size[kColumnDirectories]      = header->directoriesSize;
+    size[kColumnNames]            = header->namesSize;
+
+    for ( int c = 0; c < kColumnMax; ++c )
+    {
+        offset[c] = next;
+        next = _roundUp( next + size[c], kStorePage );
+    }
+    return next;
+}
+
+/*
+ * writing
+ */
+
+struct tStoreWriter {
+    char           *path;
+    tStoreHeader    header;
+    uint64_t        capacity;       /* rows allocated */
+
+    uint8_t        *verdict, *container, *bitDepth;
+    uint16_t       *width, *height;
+    uint32_t       *video, *audio, *kbps, *seconds, *directory, *nameOffset;
+
+    char            containerNames[kStoreMaxContainers][16];
+
+    uint32_t       *directoryOffsets;
+    uint64_t        directoryCapacity;
+    char           *directories;
+    uint64_t        directoriesCapacity;
+    char           *names;
+    uint64_t        namesCapacity;
+
+    /* directory path -> index + 1, open addressing */
+    uint32_t       *directoryHash;
+    uint64_t        directoryHashSize;
+};
+
+/* realloc, but exits on failure like the rest of the store's allocations */
+static void *_resize( void *p, uint64_t count, size_t size )
+{
+    p = realloc( p, count * size );
+    if ( p == NULL && count != 0 )
+    {
+        logError( "out of memory" );
+        exit( __LINE__ );
+    }
+    return p;
+}
+
+/* append bytes to a pool, returning their offset */
+static uint32_t _append( char **pool, uint64_t *used, uint64_t *capacity, const char *bytes, size_t length )
+{
+    uint64_t offset = *used;
+
+    if ( *used + length + 1 > UINT32_MAX )
+    {
+        logError( "too many paths for the store" );
+        exit( __LINE__ );
+    }
+    if ( *used + length + 1 > *capacity )
+    {
+        *capacity = (*capacity == 0) ? 65536 : *capacity * 2;
+        while ( *capacity < *used + length + 1 )
+            { *capacity *= 2; }
+        *pool = _resize( *pool, *capacity, 1 );
+    }
+    memcpy( *pool + *used, bytes, length );
+    (*pool)[*used + length] = '\0';
+    *used += length + 1;
+
+    return offset;
+}
+
+static uint64_t _hashBytes( const char *bytes, size_t length )
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    while ( length-- > 0 )
+    {
+        hash ^= (unsigned char)*bytes++;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static void _rehashDirectories( tStoreWriter *store )
+{
+    uint64_t    mask, slot;
+    const char *directory;
+
+    free( store->directoryHash );
+    store->directoryHashSize = (store->directoryHashSize == 0) ? 1024 : store->directoryHashSize * 2;
+    store->directoryHash = calloc( store->directoryHashSize, sizeof( uint32_t ) );
+    if ( store->directoryHash == NULL )
+    {
+        logError( "out of memory" );
+        exit( __LINE__ );
+    }
+    mask = store->directoryHashSize - 1;
+
+    for ( uint64_t d = 0; d < store->header.directoryCount; ++d )
+    {
+        directory = store->directories + store->directoryOffsets[d];
+        for ( slot = _hashBytes( directory, strlen( directory ) ) & mask; store->directoryHash[slot] != 0; slot = (slot + 1) & mask )
+            { }
+        store->directoryHash[slot] = d + 1;
+    }
+}
+
+/* the index of a directory, adding it if we haven't seen it before */
+static uint32_t _directoryIndex( tStoreWriter *store, const char *directory, size_t length )
+{
+    uint64_t    mask, slot;
+    const char *existing;
+    uint32_t    index;
+
+    if ( (store->header.directoryCount + 1) * 2 > store->directoryHashSize )
+    {
+        _rehashDirectories( store );
+    }
+    mask = store->directoryHashSize - 1;
+
+    for ( slot = _hashBytes( directory, length ) & mask; store->directoryHash[slot] != 0; slot = (slot + 1) & mask )
+    {
+        existing = store->directories + store->directoryOffsets[store->directoryHash[slot] - 1];
+        if ( strncmp( existing, directory, length ) == 0 && existing[length] == '\0' )
+        {
+            return store->directoryHash[slot] - 1;
+        }
+    }
+
+    index = store->header.directoryCount++;
+    if ( index == store->directoryCapacity )
+    {
+        store->directoryCapacity = (store->directoryCapacity == 0) ? 1024 : store->directoryCapacity * 2;
+        store->directoryOffsets = _resize( store->directoryOffsets, store->directoryCapacity, sizeof( uint32_t ) );
+    }
+    store->directoryOffsets[index] = _append( &store->directories, &store->header.directoriesSize,
+                                              &store->directoriesCapacity, directory, length );
+    store->directoryHash[slot] = index + 1;
+
+    return index;
+}
+
+static uint8_t _containerIndex( tStoreWriter *store, const char *container )
+{
+    uint32_t c;
+
+    for ( c = 0; c < store->header.containerCount; ++c )
+    {
+        if ( strncmp( store->containerNames[c], container, 16 ) == 0 )
+        {
+            return c;
+        }
+    }
+    if ( c == kStoreMaxContainers )
+    {
+        return 0;   /* can't happen - libavformat doesn't have that many demuxers we'd recognize */
+    }
+    strncpy( store->containerNames[c], container, 16 );
+    ++store->header.containerCount;
+
+    return c;
+}
+
+tStoreWriter *storeCreate( const char *path )
+{
+    tStoreWriter *store = calloc( 1, sizeof( tStoreWriter ) );
+
+    if ( store == NULL || (store->path = strdup( path )) == NULL )
+    {
+        logError( "out of memory" );
+        exit( __LINE__ );
+    }
+    memcpy( store->header.magic, kStoreMagic, sizeof( store->header.magic ) );
+    store->header.version = kStoreVersion;
+
+    /* container 0 is "no container", for files that couldn't be probed */
+    _containerIndex( store, "" );
+
+    return store;
+}
+
+int storeAdd( tStoreWriter *store, const char *path, const tProbeResult *result )
+{
+    uint64_t    row = store->header.rowCount;
+    const char *slash;
+    size_t      directoryLength;
+
+    if ( row == store->capacity )
+    {
+        store->capacity   = (store->capacity == 0) ? 65536 : store->capacity * 2;
+        store->verdict    = _resize( store->verdict,    store->capacity, sizeof( uint8_t ) );
+        store->container  = _resize( store->container,  store->capacity, sizeof( uint8_t ) );
+        store->bitDepth   = _resize( store->bitDepth,   store->capacity, sizeof( uint8_t ) );
+        store->width      = _resize( store->width,      store->capacity, sizeof( uint16_t ) );
+        store->height     = _resize( store->height,     store->capacity, sizeof( uint16_t ) );
+        store->video      = _resize( store->video,      store->capacity, sizeof( uint32_t ) );
+        store->audio      = _resize( store->audio,      store->capacity, sizeof( uint32_t ) );
+        store->kbps       = _resize( store->kbps,       store->capacity, sizeof( uint32_t ) );
+        store->seconds    = _resize( store->seconds,    store->capacity, sizeof( uint32_t ) );
+        store->directory  = _resize( store->directory,  store->capacity, sizeof( uint32_t ) );
+        store->nameOffset = _resize( store->nameOffset, store->capacity, sizeof( uint32_t ) );
+    }
+
+    slash = strrchr( path, '/' );
+    directoryLength = (slash == NULL) ? 0 : (slash == path) ? 1 : (size_t)(slash - path);
+
+    store->verdict[row]    = result->verdict;
+    store->container[row]  = _containerIndex( store, result->container );
+    store->bitDepth[row]   = result->bitDepth;
+    store->width[row]      = (result->width  > UINT16_MAX) ? UINT16_MAX : result->width;
+    store->height[row]     = (result->height > UINT16_MAX) ? UINT16_MAX : result->height;
+    store->video[row]      = result->videoCodec;
+    store->audio[row]      = result->audioCodec;
+    store->kbps[row]       = (result->bitRate > 0) ? result->bitRate / 1000 : 0;
+    store->seconds[row]    = (result->duration > 0) ? result->duration / 1000 : 0;
+    store->directory[row]  = _directoryIndex( store, path, directoryLength );
+    store->nameOffset[row] = _append( &store->names, &store->header.namesSize, &store->namesCapacity,
+                                      (slash != NULL) ? slash + 1 : path,
+                                      strlen( (slash != NULL) ? slash + 1 : path ) );
+    ++store->header.rowCount;
+
+    return 0;
+}
+
+static int _writeAt( int fd, const void *data, uint64_t size, uint64_t offset )
+{
+    const char *p = data;
+    ssize_t     count;
+
+    while ( size > 0 )
+    {
+        count = pwrite( fd, p, size, offset );
+        if ( count < 0 )
+        {
+            if ( errno == EINTR )
+                { continue; }
+            return -1;
+        }
+        p      += count;
+        size   -= count;
+        offset += count;
+    }
+    return 0;
+}
+
+int storeClose( tStoreWriter *store )
+{
+    uint64_t        offset[kColumnMax], size[kColumnMax], total;
+    const void     *column[kColumnMax];
+    char            temporary[1024];
+    int             fd, result = 0;
+
+    column[kColumnVerdict]          = store->verdict;
+    column[kColumnContainer]        = store->container;
+    column[kColumnVideo]            = store->video;
+    column[kColumnAudio]            = store->audio;
+    column[kColumnWidth]            = store->width;
+    column[kColumnHeight]           = store->height;
+    column[kColumnBitDepth]         = store->bitDepth;
+    column[kColumnKbps]             = store->kbps;
+    column[kColumnSeconds]          = store->seconds;
+    column[kColumnDirectory]        = store->directory;
+    column[kColumnNameOffset]       = store->nameOffset;
+    column[kColumnContainerNames]   = store->containerNames;
+    column[kColumnDirectoryOffsets] = store->directoryOffsets;
+    column[kColumnDirectories]      = store->directories;
+    column[kColumnNames]            = store->names;
+
+    total = storeLayout( &store->header, offset, size );
+
+    /* written alongside, and renamed into place, so a query never sees half a store */
+    snprintf( temporary, sizeof( temporary ), "%s.%d", store->path, (int)getpid() );
+    fd = open( temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if ( fd == -1 )
+    {
+        logError( "unable to create \"%s\" (%d: %s)", temporary, errno, strerror( errno ) );
+        result = -1;
+    }
+    else
+    {
+        if ( ftruncate( fd, total ) != 0 || _writeAt( fd, &store->header, sizeof( tStoreHeader ), 0 ) != 0 )
+        {
+            result = -1;
+        }
+        for ( int c = 0; c < kColumnMax && result == 0; ++c )
+        {
+            if ( size[c] > 0 && _writeAt( fd, column[c], size[c], offset[c] ) != 0 )
+            {
+                result = -1;
+            }
+        }
+        if ( result != 0 )
+        {
+            logError( "unable to write \"%s\" (%d: %s)", temporary, errno, strerror( errno ) );
+        }
+        if ( close( fd ) != 0 || result != 0 || rename( temporary, store->path ) != 0 )
+        {
+            unlink( temporary );
+            result = -1;
+        }
+        else
+        {
+            logInfo( "stored %llu results (%llu directories) in \"%s\", %llu bytes",
+                     (unsigned long long)store->header.rowCount, (unsigned long long)store->header.directoryCount,
+                     store->path, (unsigned long long)total );
+        }
+    }
+
+    for ( int c = 0; c < kColumnMax; ++c )
+    {
+        if ( c != kColumnContainerNames )
+            { free( (void *)column[c] ); }
+    }
+    free( store->directoryHash );
+    free( store->path );
+    free( store );
+
+    return result;
+}
+
+/*
+ * querying
+ */
+
+typedef struct {
+    const tStoreHeader *header;
+    uint64_t            size;
+    const void         *column[kColumnMax];
+} tStoreReader;
+
+typedef enum { kOpEqual, kOpNotEqual, kOpLess, kOpLessEqual, kOpGreater, kOpGreaterEqual } eOp;
+
+typedef struct {
+    eStoreColumn        column;
+    eOp                 op;
+    uint32_t            value;
+    uint8_t            *directoryMatch; /* for 'under', one per directory */
+} tPredicate;
+
+/* parse a value for a field. Returns 0 on success */
+typedef int (*tParseFn)( const tStoreReader *store, const char *text, uint32_t *value );
+
+typedef struct {
+    const char         *name;
+    eStoreColumn        column;
+    tParseFn            parse;
+} tField;
+
+static int _parseNumber( const tStoreReader * UNUSED(store), const char *text, uint32_t *value )
+{
+    char               *end;
+    unsigned long       number = strtoul( text, &end, 10 );
+
+    if ( end == text || *end != '\0' || number > UINT32_MAX )
+    {
+        return -1;
+    }
+    *value = number;
+    return 0;
+}
+
+static int _parseVerdict( const tStoreReader * UNUSED(store), const char *text, uint32_t *value )
+{
+    for ( eVerdict v = 0; v < kVerdictMax; ++v )
+    {
+        if ( strcasecmp( verdictToString( v ), text ) == 0 )
+        {
+            *value = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int _parseCodec( const tStoreReader * UNUSED(store), const char *text, uint32_t *value )
+{
+    const AVCodecDescriptor *codec;
+
+    if ( strcmp( text, "none" ) == 0 || strcmp( text, "-" ) == 0 )
+    {
+        *value = AV_CODEC_ID_NONE;
+        return 0;
+    }
+    codec = avcodec_descriptor_get_by_name( text );
+    if ( codec == NULL )
+    {
+        return -1;
+    }
+    *value = codec->id;
+    return 0;
+}
+
+static int _parseContainer( const tStoreReader *store, const char *text, uint32_t *value )
+{
+    const char (*names)[16] = store->column[kColumnContainerNames];
+
+    for ( uint32_t c = 0; c < store->header->containerCount; ++c )
+    {
+        if ( strncmp( names[c], text, 16 ) == 0 )
+        {
+            *value = c;
+            return 0;
+        }
+    }
+    /* not in this store, so nothing is equal to it */
+    *value = kStoreMaxContainers;
+    return 0;
+}
+
+static const tField fields[] = {
+    { "verdict",   kColumnVerdict,   _parseVerdict   },
+    { "container", kColumnContainer, _parseContainer },
+    { "video",     kColumnVideo,     _parseCodec     },
+    { "audio",     kColumnAudio,     _parseCodec     },
+    { "width",     kColumnWidth,     _parseNumber    },
+    { "height",    kColumnHeight,    _parseNumber    },
+    { "depth",     kColumnBitDepth,  _parseNumber    },
+    { "kbps",      kColumnKbps,      _parseNumber    },
+    { "seconds",   kColumnSeconds,   _parseNumber    },
+    { "under",     kColumnDirectory, NULL            },     /* a path prefix, see _matchDirectories() */
+    { NULL }
+};
+
+/* mark the directories that are 'prefix', or inside it */
+static uint8_t *_matchDirectories( const tStoreReader *store, const char *prefix )
+{
+    const uint32_t *offsets     = store->column[kColumnDirectoryOffsets];
+    const char     *directories = store->column[kColumnDirectories];
+    const char     *directory;
+    size_t          length = strlen( prefix );
+    uint8_t        *match;
+
+    while ( length > 1 && prefix[length - 1] == '/' )
+        { --length; }
+
+    match = calloc( store->header->directoryCount + 1, 1 );
+    if ( match == NULL )
+    {
+        logError( "out of memory" );
+        exit( __LINE__ );
+    }
+    for ( uint64_t d = 0; d < store->header->directoryCount; ++d )
+    {
+        directory = directories + offsets[d];
+        match[d] = strncmp( directory, prefix, length ) == 0
+                && (directory[length] == '\0' || directory[length] == '/' || prefix[length - 1] == '/');
+    }
+    return match;
+}
+
+static int _parsePredicate( const tStoreReader *store, const char *text, tPredicate *predicate )
+{
+    static const struct { const char *text; eOp op; } ops[] = {
+        { "<=", kOpLessEqual }, { ">=", kOpGreaterEqual }, { "!=", kOpNotEqual },
+        { "=",  kOpEqual },     { "<",  kOpLess },         { ">",  kOpGreater },
+        { NULL }
+    };
+    const tField   *field;
+    size_t          nameLength;
+    const char     *value;
+    int             o;
+
+    nameLength = strcspn( text, "<>!=" );
+    for ( field = fields; field->name != NULL; ++field )
+    {
+        if ( strlen( field->name ) == nameLength && strncmp( field->name, text, nameLength ) == 0 )
+        {
+            break;
+        }
+    }
+    if ( field->name == NULL )
+    {
+        logError( "\"%s\": unknown field", text );
+        return -1;
+    }
+
+    for ( o = 0; ops[o].text != NULL; ++o )
+    {
+        if ( strncmp( text + nameLength, ops[o].text, strlen( ops[o].text ) ) == 0 )
+        {
+            break;
+        }
+    }
+    if ( ops[o].text == NULL )
+    {
+        logError( "\"%s\": expected one of = != < <= > >= after \"%s\"", text, field->name );
+        return -1;
+    }
+    value = text + nameLength + strlen( ops[o].text );
+
+    predicate->column         = field->column;
+    predicate->op             = ops[o].op;
+    predicate->directoryMatch = NULL;
+
+    if ( field->parse == NULL )
+    {
+        if ( predicate->op != kOpEqual || *value == '\0' )
+        {
+            logError( "\"%s\": expected under=<path>", text );
+            return -1;
+        }
+        predicate->directoryMatch = _matchDirectories( store, value );
+        return 0;
+    }
+    if ( field->parse( store, value, &predicate->value ) != 0 )
+    {
+        logError( "\"%s\": \"%s\" isn't a valid %s", text, value, field->name );
+        return -1;
+    }
+    return 0;
+}
+
+/* mask[i] &= (column[i] <op> value), for each width of column. The switch
+   is outside the loops, so each loop is a plain compare-and-AND over
+   contiguous memory, which the compiler vectorizes */
+#define SCAN_FUNCTION( name, type ) \
+static void name( const type *column, eOp op, uint32_t value, uint8_t *mask, size_t count ) \
+{ \
+    size_t i; \
+    switch ( op ) \
+    { \
+    case kOpEqual:        for ( i = 0; i < count; ++i ) mask[i] &= (uint32_t)column[i] == value; break; \
+    case kOpNotEqual:     for ( i = 0; i < count; ++i ) mask[i] &= (uint32_t)column[i] != value; break; \
+    case kOpLess:         for ( i = 0; i < count; ++i ) mask[i] &= (uint32_t)column[i] <  value; break; \
+    case kOpLessEqual:    for ( i = 0; i < count; ++i ) mask[i] &= (uint32_t)column[i] <= value; break; \
+    case kOpGreater:      for ( i = 0; i < count; ++i ) mask[i] &= (uint32_t)column[i] >  value; break; \
+    case kOpGreaterEqual: for ( i = 0; i < count; ++i ) mask[i] &= (uint32_t)column[i] >= value; break; \
+    } \
+}
+
+SCAN_FUNCTION( _scan8,  uint8_t )
+SCAN_FUNCTION( _scan16, uint16_t )
+SCAN_FUNCTION( _scan32, uint32_t )
+
+static void _scanDirectories( const uint32_t *column, const uint8_t *match, uint8_t *mask, size_t count )
+{
+    for ( size_t i = 0; i < count; ++i )
+    {
+        mask[i] &= match[column[i]];
+    }
+}
+
+static void _applyPredicate( const tStoreReader *store, const tPredicate *predicate, uint64_t first, uint8_t *mask, size_t count )
+{
+    const void *column = store->column[predicate->column];
+
+    switch ( predicate->column )
+    {
+    case kColumnVerdict:
+    case kColumnContainer:
+    case kColumnBitDepth:
+        _scan8( (const uint8_t *)column + first, predicate->op, predicate->value, mask, count );
+        break;
+
+    case kColumnWidth:
+    case kColumnHeight:
+        _scan16( (const uint16_t *)column + first, predicate->op, predicate->value, mask, count );
+        break;
+
+    case kColumnDirectory:
+        _scanDirectories( (const uint32_t *)column + first, predicate->directoryMatch, mask, count );
+        break;
+
+    default:
+        _scan32( (const uint32_t *)column + first, predicate->op, predicate->value, mask, count );
+        break;
+    }
+}
+
+static void _printRow( FILE *output, const tStoreReader *store, uint64_t row )
+{
+    const char      (*containers)[16] = store->column[kColumnContainerNames];
+    const uint32_t   *offsets         = store->column[kColumnDirectoryOffsets];
+    const char       *directory, *name;
+    tProbeResult      result;
+    char              path[8192];
+
+    memset( &result, 0, sizeof( result ) );
+    result.verdict    = ((const uint8_t *)store->column[kColumnVerdict])[row];
+    result.videoCodec = ((const uint32_t *)store->column[kColumnVideo])[row];
+    result.audioCodec = ((const uint32_t *)store->column[kColumnAudio])[row];
+    result.width      = ((const uint16_t *)store->column[kColumnWidth])[row];
+    result.height     = ((const uint16_t *)store->column[kColumnHeight])[row];
+    result.bitDepth   = ((const uint8_t *)store->column[kColumnBitDepth])[row];
+    result.bitRate    = (int64_t)((const uint32_t *)store->column[kColumnKbps])[row] * 1000;
+    result.duration   = (int64_t)((const uint32_t *)store->column[kColumnSeconds])[row] * 1000;
+    memcpy( result.container, containers[((const uint8_t *)store->column[kColumnContainer])[row]], 16 );
+    result.container[sizeof( result.container ) - 1] = '\0';
+
+    directory = (const char *)store->column[kColumnDirectories]
+              + offsets[((const uint32_t *)store->column[kColumnDirectory])[row]];
+    name      = (const char *)store->column[kColumnNames] + ((const uint32_t *)store->column[kColumnNameOffset])[row];
+    /* a file in the root directory is stored as "/" + name, in the current one as "" + name */
+    snprintf( path, sizeof( path ), "%s%s%s", directory,
+              (directory[0] != '\0' && directory[strlen( directory ) - 1] != '/') ? "/" : "", name );
+
+    printProbeResult( output, path, &result );
+}
+
+static int _openStore( const char *path, tStoreReader *store )
+{
+    uint64_t        offset[kColumnMax], size[kColumnMax];
+    struct stat     st;
+    void           *memory;
+    int             fd;
+
+    fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd == -1 || fstat( fd, &st ) != 0 )
+    {
+        logError( "unable to open the store \"%s\" (%d: %s)", path, errno, strerror( errno ) );
+        if ( fd != -1 )
+            { close( fd ); }
+        return -1;
+    }
+    if ( (size_t)st.st_size < sizeof( tStoreHeader ) )
+    {
+        logError( "\"%s\" is not a result store", path );
+        close( fd );
+        return -1;
+    }
+    memory = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( memory == MAP_FAILED )
+    {
+        logError( "unable to map the store \"%s\" (%d: %s)", path, errno, strerror( errno ) );
+        return -1;
+    }
+
+    store->header = memory;
+    store->size   = st.st_size;
+    if ( memcmp( store->header->magic, kStoreMagic, sizeof( store->header->magic ) ) != 0
+      || store->header->version != kStoreVersion
+      || store->header->containerCount > kStoreMaxContainers
+      || storeLayout( store->header, offset, size ) > (uint64_t)st.st_size )
+    {
+        logError( "\"%s\" is not a result store (or is from a different version)", path );
+        munmap( memory, st.st_size );
+        return -1;
+    }
+    for ( int c = 0; c < kColumnMax; ++c )
+    {
+        store->column[c] = (const char *)memory + offset[c];
+    }
+    return 0;
+}
+
+int storeQuery( FILE *output, const char *path, int argc, const char *argv[] )
+{
+    tStoreReader    store;
+    tPredicate     *predicates;
+    uint8_t         mask[kStoreBlock];
+    uint64_t        rows, first, matched = 0;
+    size_t          count;
+    uint64_t        start;
+    int             result = 0;
+
+    if ( _openStore( path, &store ) != 0 )
+    {
+        return -1;
+    }
+
+    predicates = calloc( argc + 1, sizeof( tPredicate ) );
+    if ( predicates == NULL )
+    {
+        logError( "out of memory" );
+        exit( __LINE__ );
+    }
+    for ( int p = 0; p < argc && result == 0; ++p )
+    {
+        result = _parsePredicate( &store, argv[p], &predicates[p] );
+    }
+
+    if ( result == 0 )
+    {
+        start = statsNow();
+        rows  = store.header->rowCount;
+        for ( first = 0; first < rows; first += count )
+        {
+            count = (rows - first < kStoreBlock) ? rows - first : kStoreBlock;
+            memset( mask, 1, count );
+            for ( int p = 0; p < argc; ++p )
+            {
+                _applyPredicate( &store, &predicates[p], first, mask, count );
+            }
+            for ( size_t i = 0; i < count; ++i )
+            {
+                if ( mask[i] )
+                {
+                    _printRow( output, &store, first + i );
+                    ++matched;
+                }
+            }
+        }
+        logInfo( "%llu of %llu results matched, in %.3f ms",
+                 (unsigned long long)matched, (unsigned long long)rows, (statsNow() - start) / 1e6 );
+    }
+
+    for ( int p = 0; p < argc; ++p )
+    {
+        free( predicates[p].directoryMatch );
+    }
+    free( predicates );
+    munmap( (void *)store.header, store.size );
+
+    return result;
+}
@@ -0,0 +1,67 @@
+/*
+    a compact, columnar store of probe results, and queries over it
+*/
+
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "probe.h"
+
+#define kStoreMagic     "FFTSTOR1"
+#define kStoreVersion   1
+
+/*
+    The file is a header followed by one segment per column, each starting
+    on a page boundary at an offset that follows from the counts in the
+    header (see storeLayout()), so a reader can mmap it and use the columns
+    in place. Paths are split into a directory, shared by every file in it,
+    and a name.
+*/
+typedef enum {
+    kColumnVerdict,         /* uint8_t   eVerdict */
+    kColumnContainer,       /* uint8_t   index into kColumnContainerNames */
+    kColumnVideo,           /* uint32_t  enum AVCodecID */
+    kColumnAudio,           /* uint32_t  enum AVCodecID */
+    kColumnWidth,           /* uint16_t */
+    kColumnHeight,          /* uint16_t */
+    kColumnBitDepth,        /* uint8_t */
+    kColumnKbps,            /* uint32_t  overall bit rate, kbit/s */
+    kColumnSeconds,         /* uint32_t  duration */
+    kColumnDirectory,       /* uint32_t  index into kColumnDirectoryOffsets */
+    kColumnNameOffset,      /* uint32_t  offset into kColumnNames */
+    kColumnContainerNames,  /* char[16] per container */
+    kColumnDirectoryOffsets,/* uint32_t  offset into kColumnDirectories, per directory */
+    kColumnDirectories,     /* NUL terminated directory paths */
+    kColumnNames,           /* NUL terminated file names */
+    kColumnMax
+} eStoreColumn;
+
+typedef struct {
+    char            magic[8];       /* kStoreMagic */
+    uint32_t        version;        /* kStoreVersion */
+    uint32_t        containerCount;
+    uint64_t        rowCount;
+    uint64_t        directoryCount;
+    uint64_t        directoriesSize;    /* bytes */
+    uint64_t        namesSize;          /* bytes */
+} tStoreHeader;
+
+/* the offset and size of each column, for the counts in a header.
+   Returns the total size of the file */
+uint64_t        storeLayout( const tStoreHeader *header, uint64_t offset[kColumnMax], uint64_t size[kColumnMax] );
+
+/* collect results in memory, and write them out as a store at storeClose() */
+typedef struct tStoreWriter tStoreWriter;
+
+tStoreWriter *  storeCreate( const char *path );
+int             storeAdd( tStoreWriter *store, const char *path, const tProbeResult *result );
+int             storeClose( tStoreWriter *store );
+
+/* 'fftest query <store> [<field><op><value> ...]': print the results that
+   match every predicate. Returns 0 on success */
+int             storeQuery( FILE *output, const char *path, int argc, const char *argv[] );
+
+#endif
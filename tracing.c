@@ -0,0 +1,833 @@
+/*
+    Function tracing and profiling.
+
+    gcc inserts calls to __cyg_profile_func_enter/exit at the beginning and
+    end of every compiled function when the -finstrument-functions option
+    is used ('make trace'). The hooks only append a raw (timestamp, function,
+    call site) event to a buffer belonging to the calling thread, no locks,
+    no symbol lookups and no formatting. When the trace is written out, the
+    addresses are resolved through a cache, so dladdr() is called once per
+    distinct address, and the events are written as Chrome trace JSON, which
+    chrome://tracing and ui.perfetto.dev can both load.
+
+    Recording stops once kTraceMaxEvents have been collected, rather than
+    eating all the memory in the machine.
+
+    Profiling is the inexpensive alternative: no events are kept, just a
+    shadow call stack and two fixed-size open-addressed tables per thread,
+    one of per-function call counts and cycle totals, one of caller->callee
+    edge counts. Nothing is resolved to a name until the profile is written.
+*/
+
+#define  _GNU_SOURCE  /* dladdr is a gcc extension */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include <dlfcn.h>
+
+#include "common.h"
+#include "tracing.h"
+#include "logging.h"
+
+#define kTraceChunkEvents   (64 * 1024)
+#define kTraceMaxEvents     (8 * 1024 * 1024)   /* ~200MB of events, across all threads */
+#define kTraceExit          (1ULL << 63)        /* set in the timestamp of an exit event */
+
+typedef struct {
+    uint64_t        timestamp;  /* nanoseconds since startTracing(), kTraceExit set for an exit */
+    void           *function;
+    void           *callSite;
+} tTraceEvent;
+
+typedef struct tTraceChunk {
+    struct tTraceChunk *next;
+    size_t              count;  /* written by the owning thread, read by dumpTrace() */
+    tTraceEvent         events[kTraceChunkEvents];
+} tTraceChunk;
+
+typedef struct tTraceThread {
+    struct tTraceThread *next;  /* every thread that has recorded anything */
+    pid_t                tid;
+    tTraceChunk         *first;
+    tTraceChunk         *current;
+} tTraceThread;
+
+typedef enum { kTraceOff, kTraceEvents, kTraceProfile } eTraceMode;
+
+static const char      *gTraceFile     = NULL;
+static eTraceMode       gTraceMode     = kTraceOff;
+static uint64_t         gTraceStart;
+static tTraceThread    *gTraceThreads  = NULL;
+static size_t           gTraceEvents   = 0;
+static size_t           gTraceDropped  = 0;
+
+static __thread tTraceThread *tlTrace = NULL;
+
+/* held while a trace or profile is written. A SIGUSR2 can have any thread
+   dump the profile while the main thread's stopTracing() does the same, and
+   they share the symbol cache and the output file */
+static pthread_mutex_t  gDumpLock      = PTHREAD_MUTEX_INITIALIZER;
+
+/********** DO NOT INSTRUMENT THE INSTRUMENTATION! **********/
+
+void __cyg_profile_func_enter(void *this_fn, void *call_site)
+                            __attribute__((no_instrument_function));
+
+void __cyg_profile_func_exit(void *this_fn, void *call_site)
+                            __attribute__((no_instrument_function));
+
+static uint64_t _traceNow( void )
+                            __attribute__((no_instrument_function));
+
+static tTraceThread *_traceThread( void )
+                            __attribute__((no_instrument_function));
+
+static void _traceRecord( uint64_t flags, void *function, void *callSite )
+                            __attribute__((no_instrument_function));
+
+static const char *_traceSymbol( void *address )
+                            __attribute__((no_instrument_function));
+
+static void _profileEnter( void *function, void *callSite )
+                            __attribute__((no_instrument_function));
+
+static void _profileExit( void *function )
+                            __attribute__((no_instrument_function));
+
+static int _dumpProfile( const char *profileFile )
+                            __attribute__((no_instrument_function));
+
+/********** DO NOT INSTRUMENT THE INSTRUMENTATION! **********/
+
+static uint64_t _traceNow( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* the calling thread's trace, created (and linked into gTraceThreads) on first use */
+static tTraceThread *_traceThread( void )
+{
+    tTraceThread *thread = tlTrace;
+
+    if ( thread == NULL )
+    {
+        thread = calloc( 1, sizeof( tTraceThread ) );
+        if ( thread != NULL )
+        {
+            thread->tid = syscall( SYS_gettid );
+            thread->next = __atomic_load_n( &gTraceThreads, __ATOMIC_RELAXED );
+            while ( !__atomic_compare_exchange_n( &gTraceThreads, &thread->next, thread, 1,
+                                                  __ATOMIC_RELEASE, __ATOMIC_RELAXED ) )
+                { /* thread->next has been refreshed, try again */ }
+            tlTrace = thread;
+        }
+    }
+    return thread;
+}
+
+static void _traceRecord( uint64_t flags, void *function, void *callSite )
+{
+    tTraceThread   *thread;
+    tTraceChunk    *chunk;
+    tTraceEvent    *event;
+
+    thread = _traceThread();
+    if ( thread == NULL )
+    {
+        return;
+    }
+
+    chunk = thread->current;
+    if ( chunk == NULL || chunk->count == kTraceChunkEvents )
+    {
+        if ( __atomic_add_fetch( &gTraceEvents, kTraceChunkEvents, __ATOMIC_RELAXED ) > kTraceMaxEvents )
+        {
+            __atomic_add_fetch( &gTraceDropped, 1, __ATOMIC_RELAXED );
+            __atomic_sub_fetch( &gTraceEvents, kTraceChunkEvents, __ATOMIC_RELAXED );
+            return;
+        }
+        chunk = calloc( 1, sizeof( tTraceChunk ) );
+        if ( chunk == NULL )
+        {
+            return;
+        }
+        if ( thread->current == NULL )
+            { __atomic_store_n( &thread->first, chunk, __ATOMIC_RELEASE ); }
+        else
+            { __atomic_store_n( &thread->current->next, chunk, __ATOMIC_RELEASE ); }
+        thread->current = chunk;
+    }
+
+    event = &chunk->events[chunk->count];
+    event->timestamp = (_traceNow() - gTraceStart) | flags;
+    event->function  = function;
+    event->callSite  = callSite;
+    /* publish the event to dumpTrace() */
+    __atomic_store_n( &chunk->count, chunk->count + 1, __ATOMIC_RELEASE );
+}
+
+/*
+    profiling
+ */
+
+#define kProfileFunctions   4096        /* per thread, must be a power of two */
+#define kProfileEdges       16384       /* per thread, must be a power of two */
+#define kProfileStackDepth  1024
+
+typedef struct {
+    void           *function;
+    uint64_t        calls;
+    uint64_t        inclusive;      /* cycles, counted once for recursive calls */
+    uint64_t        exclusive;      /* cycles, less the time spent in callees */
+    uint32_t        active;         /* how many times it's on the stack right now */
+} tProfileFunction;
+
+typedef struct {
+    void           *caller;
+    void           *callee;
+    uint64_t        calls;
+} tProfileEdge;
+
+typedef struct {
+    tProfileFunction   *entry;
+    uint64_t            start;      /* cycle count on entry */
+    uint64_t            children;   /* cycles spent in callees */
+} tProfileFrame;
+
+typedef struct tProfileThread {
+    struct tProfileThread *next;    /* every thread that has been profiled */
+    pid_t               tid;
+    int                 depth;
+    uint64_t            dropped;    /* calls that didn't fit in a table or the stack */
+    tProfileFrame       stack[kProfileStackDepth];
+    tProfileFunction    functions[kProfileFunctions];
+    tProfileEdge        edges[kProfileEdges];
+} tProfileThread;
+
+static tProfileThread  *gProfileThreads = NULL;
+static int              gProfileDumpRequested = 0;
+static uint64_t         gProfileStartCycles;
+
+static __thread tProfileThread *tlProfile = NULL;
+
+static inline uint64_t _profileCycles( void )
+                            __attribute__((no_instrument_function));
+
+static inline uint64_t _profileCycles( void )
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return _traceNow();
+#endif
+}
+
+static inline size_t _profileHash( void *a, void *b )
+                            __attribute__((no_instrument_function));
+
+static inline size_t _profileHash( void *a, void *b )
+{
+    return (((uintptr_t)a ^ ((uintptr_t)b * 31)) * 0x9E3779B97F4A7C15ULL) >> 32;
+}
+
+static void _profileEnter( void *function, void *callSite )
+{
+    tProfileThread     *thread = tlProfile;
+    tProfileFunction   *entry;
+    tProfileEdge       *edge;
+    tProfileFrame      *frame;
+    void               *caller;
+    size_t              slot;
+
+    if ( thread == NULL )
+    {
+        thread = calloc( 1, sizeof( tProfileThread ) );
+        if ( thread == NULL )
+        {
+            return;
+        }
+        thread->tid  = syscall( SYS_gettid );
+        thread->next = __atomic_load_n( &gProfileThreads, __ATOMIC_RELAXED );
+        while ( !__atomic_compare_exchange_n( &gProfileThreads, &thread->next, thread, 1,
+                                              __ATOMIC_RELEASE, __ATOMIC_RELAXED ) )
+            { /* thread->next has been refreshed, try again */ }
+        tlProfile = thread;
+    }
+
+    /* find (or claim) this function's entry */
+    entry = NULL;
+    slot  = _profileHash( function, NULL );
+    for ( int probe = 0; probe < kProfileFunctions; ++probe, ++slot )
+    {
+        entry = &thread->functions[slot & (kProfileFunctions - 1)];
+        if ( entry->function == function )
+        {
+            break;
+        }
+        if ( entry->function == NULL )
+        {
+            __atomic_store_n( &entry->function, function, __ATOMIC_RELEASE );
+            break;
+        }
+        entry = NULL;
+    }
+
+    if ( entry == NULL || thread->depth == kProfileStackDepth )
+    {
+        /* push a placeholder, so the exit still lines up */
+        ++thread->dropped;
+        if ( thread->depth < kProfileStackDepth )
+        {
+            thread->stack[thread->depth].entry = NULL;
+        }
+        ++thread->depth;
+        return;
+    }
+
+    /* the caller is whoever is on top of the stack, or the call site if we started mid-stack */
+    caller = (thread->depth > 0 && thread->depth <= kProfileStackDepth && thread->stack[thread->depth - 1].entry != NULL)
+                ? thread->stack[thread->depth - 1].entry->function
+                : callSite;
+
+    slot = _profileHash( caller, function );
+    for ( int probe = 0; probe < kProfileEdges; ++probe, ++slot )
+    {
+        edge = &thread->edges[slot & (kProfileEdges - 1)];
+        if ( edge->caller == caller && edge->callee == function )
+        {
+            ++edge->calls;
+            break;
+        }
+        if ( edge->callee == NULL )
+        {
+            edge->caller = caller;
+            edge->calls  = 1;
+            __atomic_store_n( &edge->callee, function, __ATOMIC_RELEASE );
+            break;
+        }
+    }
+
+    ++entry->calls;
+    ++entry->active;
+
+    frame = &thread->stack[thread->depth++];
+    frame->entry    = entry;
+    frame->children = 0;
+    frame->start    = _profileCycles();
+}
+
+static void _profileExit( void *function )
+{
+    tProfileThread     *thread = tlProfile;
+    tProfileFrame      *frame;
+    uint64_t            elapsed;
+    int                 depth;
+
+    if ( thread == NULL || thread->depth == 0 )
+    {
+        /* returning from something entered before profiling started */
+        return;
+    }
+
+    if ( thread->depth > kProfileStackDepth || thread->stack[thread->depth - 1].entry == NULL )
+    {
+        --thread->depth;
+        return;
+    }
+
+    /* normally the top of the stack; if not, a longjmp skipped some exits */
+    for ( depth = thread->depth - 1; depth >= 0; --depth )
+    {
+        if ( thread->stack[depth].entry != NULL && thread->stack[depth].entry->function == function )
+        {
+            break;
+        }
+    }
+    if ( depth < 0 )
+    {
+        return;
+    }
+
+    while ( thread->depth > depth )
+    {
+        frame   = &thread->stack[--thread->depth];
+        if ( frame->entry == NULL )
+        {
+            continue;
+        }
+        elapsed = _profileCycles() - frame->start;
+
+        frame->entry->exclusive += elapsed - frame->children;
+        if ( --frame->entry->active == 0 )
+        {
+            frame->entry->inclusive += elapsed;
+        }
+        if ( thread->depth > 0 )
+        {
+            thread->stack[thread->depth - 1].children += elapsed;
+        }
+    }
+}
+
+void profileDumpSignal( int UNUSED(signal) )
+{
+    __atomic_store_n( &gProfileDumpRequested, 1, __ATOMIC_RELEASE );
+}
+
+/* just landed in a function */
+void __cyg_profile_func_enter(void *this_fn, void *call_site)
+{
+    switch ( gTraceMode )
+    {
+    case kTraceEvents:
+        if ( gFunctionTraceEnabled )
+        {
+            _traceRecord( 0, this_fn, call_site );
+        }
+        break;
+
+    case kTraceProfile:
+        _profileEnter( this_fn, call_site );
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* about to leave a function */
+void __cyg_profile_func_exit(void *this_fn, void *call_site)
+{
+    switch ( gTraceMode )
+    {
+    case kTraceEvents:
+        if ( gFunctionTraceEnabled )
+        {
+            _traceRecord( kTraceExit, this_fn, call_site );
+        }
+        break;
+
+    case kTraceProfile:
+        _profileExit( this_fn );
+        if ( gProfileDumpRequested && __atomic_exchange_n( &gProfileDumpRequested, 0, __ATOMIC_ACQ_REL ) )
+        {
+            /* never wait here: a dump already being written, by this thread
+               or another, will do instead */
+            if ( pthread_mutex_trylock( &gDumpLock ) == 0 )
+            {
+                _dumpProfile( gTraceFile );
+                pthread_mutex_unlock( &gDumpLock );
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+/*
+    symbol cache: open addressing, keyed by address. Only used while writing
+    out the trace or profile, under gDumpLock, so it can use malloc freely.
+ */
+
+typedef struct {
+    void           *address;
+    char           *name;
+} tTraceSymbol;
+
+static tTraceSymbol    *gSymbols;
+static size_t           gSymbolCapacity;    /* always a power of two */
+static size_t           gSymbolCount;
+
+static size_t _symbolSlot( tTraceSymbol *table, size_t capacity, void *address )
+{
+    size_t slot = ((uintptr_t)address * 0x9E3779B97F4A7C15ULL) >> 20;
+
+    for ( slot &= capacity - 1; table[slot].address != NULL && table[slot].address != address; slot = (slot + 1) & (capacity - 1) )
+        { /* linear probe */ }
+    return slot;
+}
+
+static const char *_traceSymbol( void *address )
+{
+    tTraceSymbol   *table;
+    size_t          slot, capacity;
+    Dl_info         info;
+    char            scratch[64];
+    const char     *module;
+
+    if ( gSymbolCount * 2 >= gSymbolCapacity )
+    {
+        capacity = (gSymbolCapacity == 0) ? 1024 : gSymbolCapacity * 2;
+        table = calloc( capacity, sizeof( tTraceSymbol ) );
+        if ( table == NULL )
+        {
+            return "?";
+        }
+        for ( size_t i = 0; i < gSymbolCapacity; ++i )
+        {
+            if ( gSymbols[i].address != NULL )
+            {
+                table[_symbolSlot( table, capacity, gSymbols[i].address )] = gSymbols[i];
+            }
+        }
+        free( gSymbols );
+        gSymbols        = table;
+        gSymbolCapacity = capacity;
+    }
+
+    slot = _symbolSlot( gSymbols, gSymbolCapacity, address );
+    if ( gSymbols[slot].address == NULL )
+    {
+        /* first time we've seen this one */
+        memset( &info, 0, sizeof( info ) );
+        if ( dladdr( address, &info ) != 0 && info.dli_sname != NULL )
+        {
+            gSymbols[slot].name = strdup( info.dli_sname );
+        }
+        else
+        {
+            /* not exported (static, or not linked with --export-dynamic); leave enough for addr2line */
+            module = (info.dli_fname != NULL) ? strrchr( info.dli_fname, '/' ) : NULL;
+            snprintf( scratch, sizeof( scratch ), "%s+0x%lx",
+                      (module != NULL) ? module + 1 : "?",
+                      (unsigned long)((uintptr_t)address - (uintptr_t)info.dli_fbase) );
+            gSymbols[slot].name = strdup( scratch );
+        }
+        gSymbols[slot].address = address;
+        ++gSymbolCount;
+    }
+
+    return (gSymbols[slot].name != NULL) ? gSymbols[slot].name : "?";
+}
+
+/* symbols are plain C identifiers, but be safe */
+static void _writeJSONString( FILE *file, const char *string )
+{
+    fputc( '"', file );
+    for ( ; *string != '\0'; ++string )
+    {
+        if ( *string == '"' || *string == '\\' )
+            { fputc( '\\', file ); }
+        if ( (unsigned char)*string >= ' ' )
+            { fputc( *string, file ); }
+    }
+    fputc( '"', file );
+}
+
+static int _dumpTrace( const char *traceFile )
+{
+    FILE           *file;
+    tTraceThread   *thread;
+    tTraceChunk    *chunk;
+    tTraceEvent    *event;
+    size_t          count, total = 0;
+    int             pid = getpid();
+    const char     *separator = "\n";
+
+    file = fopen( traceFile, "w" );
+    if ( file == NULL )
+    {
+        logError( "unable to create trace file \"%s\" (%d: %s)", traceFile, errno, strerror( errno ) );
+        return -1;
+    }
+
+    fprintf( file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" );
+
+    for ( thread = __atomic_load_n( &gTraceThreads, __ATOMIC_ACQUIRE ); thread != NULL; thread = thread->next )
+    {
+        fprintf( file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                 separator, pid, thread->tid, (thread->tid == pid) ? "main" : "thread", thread->tid );
+        separator = ",\n";
+
+        for ( chunk = __atomic_load_n( &thread->first, __ATOMIC_ACQUIRE ); chunk != NULL; chunk = __atomic_load_n( &chunk->next, __ATOMIC_ACQUIRE ) )
+        {
+            count = __atomic_load_n( &chunk->count, __ATOMIC_ACQUIRE );
+            for ( size_t i = 0; i < count; ++i )
+            {
+                event = &chunk->events[i];
+
+                fprintf( file, ",\n{\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"name\":",
+                         (event->timestamp & kTraceExit) ? 'E' : 'B', pid, thread->tid,
+                         (event->timestamp & ~kTraceExit) / 1000.0 );
+                _writeJSONString( file, _traceSymbol( event->function ) );
+                if ( !(event->timestamp & kTraceExit) )
+                {
+                    fprintf( file, ",\"args\":{\"from\":" );
+                    _writeJSONString( file, _traceSymbol( event->callSite ) );
+                    fputc( '}', file );
+                }
+                fputc( '}', file );
+            }
+            total += count;
+        }
+    }
+
+    fprintf( file, "\n]}\n" );
+
+    if ( fclose( file ) != 0 )
+    {
+        logError( "unable to write trace file \"%s\" (%d: %s)", traceFile, errno, strerror( errno ) );
+        return -1;
+    }
+
+    if ( total == 0 )
+    {
+        logWarning( "no function calls were traced; was this built with 'make trace'?" );
+    }
+    else
+    {
+        logInfo( "wrote %zu trace events for %zu functions/call sites to \"%s\"", total, gSymbolCount, traceFile );
+    }
+    if ( gTraceDropped != 0 )
+    {
+        logWarning( "the trace filled up, and stopped after %d events", kTraceMaxEvents );
+    }
+
+    return 0;
+}
+
+static int _compareFunctionAddress( const void *left, const void *right )
+{
+    const tProfileFunction *l = left, *r = right;
+
+    return (l->function > r->function) - (l->function < r->function);
+}
+
+static int _compareExclusive( const void *left, const void *right )
+{
+    const tProfileFunction *l = left, *r = right;
+
+    return (l->exclusive < r->exclusive) - (l->exclusive > r->exclusive);
+}
+
+static int _compareEdgeAddress( const void *left, const void *right )
+{
+    const tProfileEdge *l = left, *r = right;
+
+    if ( l->caller != r->caller )
+    {
+        return (l->caller > r->caller) - (l->caller < r->caller);
+    }
+    return (l->callee > r->callee) - (l->callee < r->callee);
+}
+
+static int _compareEdgeCalls( const void *left, const void *right )
+{
+    const tProfileEdge *l = left, *r = right;
+
+    return (l->calls < r->calls) - (l->calls > r->calls);
+}
+
+static int _dumpProfile( const char *profileFile )
+{
+    FILE               *file;
+    tProfileThread     *thread;
+    tProfileFunction   *functions, *entry;
+    tProfileEdge       *edges, *edge;
+    size_t              functionCount = 0, edgeCount = 0, threadCount = 0, merged;
+    uint64_t            totalCycles = 0, totalCalls = 0, dropped = 0;
+    double              cyclesPerMs;
+
+    /* pull every thread's tables together. Other threads may still be
+       running, so their counts are a snapshot, but never torn */
+    for ( thread = __atomic_load_n( &gProfileThreads, __ATOMIC_ACQUIRE ); thread != NULL; thread = thread->next )
+    {
+        ++threadCount;
+    }
+    functions = calloc( threadCount * kProfileFunctions + 1, sizeof( tProfileFunction ) );
+    edges     = calloc( threadCount * kProfileEdges + 1,     sizeof( tProfileEdge ) );
+    if ( functions == NULL || edges == NULL )
+    {
+        free( functions );
+        free( edges );
+        logError( "not enough memory to write the profile" );
+        return -1;
+    }
+
+    thread = __atomic_load_n( &gProfileThreads, __ATOMIC_ACQUIRE );
+    for ( size_t t = 0; t < threadCount; ++t, thread = thread->next )
+    {
+        for ( size_t i = 0; i < kProfileFunctions; ++i )
+        {
+            if ( __atomic_load_n( &thread->functions[i].function, __ATOMIC_ACQUIRE ) != NULL )
+            {
+                functions[functionCount++] = thread->functions[i];
+            }
+        }
+        for ( size_t i = 0; i < kProfileEdges; ++i )
+        {
+            if ( __atomic_load_n( &thread->edges[i].callee, __ATOMIC_ACQUIRE ) != NULL )
+            {
+                edges[edgeCount++] = thread->edges[i];
+            }
+        }
+        dropped += thread->dropped;
+    }
+
+    /* the same function may appear once per thread; combine them */
+    qsort( functions, functionCount, sizeof( tProfileFunction ), _compareFunctionAddress );
+    merged = 0;
+    for ( size_t i = 0; i < functionCount; ++i )
+    {
+        if ( merged > 0 && functions[merged - 1].function == functions[i].function )
+        {
+            functions[merged - 1].calls     += functions[i].calls;
+            functions[merged - 1].inclusive += functions[i].inclusive;
+            functions[merged - 1].exclusive += functions[i].exclusive;
+        }
+        else
+        {
+            functions[merged++] = functions[i];
+        }
+        totalCycles += functions[i].exclusive;
+        totalCalls  += functions[i].calls;
+    }
+    functionCount = merged;
+    qsort( functions, functionCount, sizeof( tProfileFunction ), _compareExclusive );
+
+    qsort( edges, edgeCount, sizeof( tProfileEdge ), _compareEdgeAddress );
+    merged = 0;
+    for ( size_t i = 0; i < edgeCount; ++i )
+    {
+        if ( merged > 0 && edges[merged - 1].caller == edges[i].caller && edges[merged - 1].callee == edges[i].callee )
+            { edges[merged - 1].calls += edges[i].calls; }
+        else
+            { edges[merged++] = edges[i]; }
+    }
+    edgeCount = merged;
+    qsort( edges, edgeCount, sizeof( tProfileEdge ), _compareEdgeCalls );
+
+    /* calibrate the cycle counter against the clock, over the whole run */
+    cyclesPerMs = (double)(_profileCycles() - gProfileStartCycles) / ((_traceNow() - gTraceStart) / 1e6);
+    if ( cyclesPerMs <= 0 )
+    {
+        cyclesPerMs = 1;
+    }
+
+    file = fopen( profileFile, "w" );
+    if ( file == NULL )
+    {
+        logError( "unable to create profile \"%s\" (%d: %s)", profileFile, errno, strerror( errno ) );
+        free( functions );
+        free( edges );
+        return -1;
+    }
+
+    fprintf( file, "flat profile: %llu calls to %zu functions on %zu threads, %.2f GHz cycle counter\n",
+             (unsigned long long)totalCalls, functionCount, threadCount, cyclesPerMs / 1e6 );
+    if ( dropped != 0 )
+    {
+        fprintf( file, "(%llu calls weren't counted, the tables or the stack were full)\n", (unsigned long long)dropped );
+    }
+    fprintf( file, "\n %%excl  exclusive ms  inclusive ms         calls  function\n" );
+    for ( size_t i = 0; i < functionCount; ++i )
+    {
+        entry = &functions[i];
+        fprintf( file, "%6.2f %13.3f %13.3f %13llu  %s\n",
+                 (totalCycles != 0) ? 100.0 * entry->exclusive / totalCycles : 0.0,
+                 entry->exclusive / cyclesPerMs, entry->inclusive / cyclesPerMs,
+                 (unsigned long long)entry->calls, _traceSymbol( entry->function ) );
+    }
+
+    fprintf( file, "\ncall graph edges, most frequent first\n\n         calls  caller -> callee\n" );
+    for ( size_t i = 0; i < edgeCount; ++i )
+    {
+        edge = &edges[i];
+        fprintf( file, "%14llu  %s -> ", (unsigned long long)edge->calls, _traceSymbol( edge->caller ) );
+        fprintf( file, "%s\n", _traceSymbol( edge->callee ) );
+    }
+
+    free( functions );
+    free( edges );
+
+    if ( fclose( file ) != 0 )
+    {
+        logError( "unable to write profile \"%s\" (%d: %s)", profileFile, errno, strerror( errno ) );
+        return -1;
+    }
+
+    if ( functionCount == 0 )
+    {
+        logWarning( "no function calls were profiled; was this built with 'make trace'?" );
+    }
+    else
+    {
+        logInfo( "wrote the profile of %zu functions to \"%s\"", functionCount, profileFile );
+    }
+
+    return 0;
+}
+
+int dumpTrace( const char *traceFile )
+{
+    int result;
+
+    pthread_mutex_lock( &gDumpLock );
+    result = _dumpTrace( traceFile );
+    pthread_mutex_unlock( &gDumpLock );
+    return result;
+}
+
+int dumpProfile( const char *profileFile )
+{
+    int result;
+
+    pthread_mutex_lock( &gDumpLock );
+    result = _dumpProfile( profileFile );
+    pthread_mutex_unlock( &gDumpLock );
+    return result;
+}
+
+void startTracing( const char *traceFile )
+{
+    gTraceFile  = traceFile;
+    gTraceStart = _traceNow();
+    __atomic_store_n( &gTraceMode, kTraceEvents, __ATOMIC_RELEASE );
+
+    atexit( &stopTracing );
+}
+
+void startProfiling( const char *profileFile )
+{
+    gTraceFile          = profileFile;
+    gTraceStart         = _traceNow();
+    gProfileStartCycles = _profileCycles();
+    __atomic_store_n( &gTraceMode, kTraceProfile, __ATOMIC_RELEASE );
+
+    atexit( &stopTracing );
+}
+
+void stopTracing( void )
+{
+    eTraceMode mode = __atomic_exchange_n( &gTraceMode, kTraceOff, __ATOMIC_ACQ_REL );
+
+    if ( gTraceFile != NULL )
+    {
+        switch ( mode )
+        {
+        case kTraceEvents:
+            dumpTrace( gTraceFile );
+            break;
+
+        case kTraceProfile:
+            dumpProfile( gTraceFile );
+            break;
+
+        default:
+            break;
+        }
+    }
+}
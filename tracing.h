@@ -0,0 +1,31 @@
+/*
+    function tracing and profiling, driven by gcc's -finstrument-functions hooks ('make trace')
+*/
+
+#ifndef TRACING_H
+#define TRACING_H
+
+/* start recording function entry & exit into per-thread buffers. Nothing is
+   formatted until the trace is written out, as Chrome/Perfetto trace JSON,
+   to traceFile by stopTracing() (or at exit). logFunctionTraceOn/Off pause
+   and resume the recording. */
+void    startTracing( const char *traceFile );
+
+/* instead of a full trace, keep per-function call counts, inclusive and
+   exclusive cycles and caller->callee edge counts in a fixed-size table per
+   thread. The sorted profile goes to profileFile at stopTracing() (or at
+   exit), and whenever the process receives SIGUSR2. */
+void    startProfiling( const char *profileFile );
+
+/* stop recording and write out the trace (or profile) */
+void    stopTracing( void );
+
+/* write whatever has been recorded so far to traceFile. Returns 0 on success */
+int     dumpTrace( const char *traceFile );
+int     dumpProfile( const char *profileFile );
+
+/* SIGUSR2 handler: asks for the profile to be written out. The next
+   instrumented function to return does the work, outside the handler */
+void    profileDumpSignal( int signal );
+
+#endif